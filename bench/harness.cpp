@@ -0,0 +1,308 @@
+// Replay load harness: runs engine scripts against a local mock upstream at
+// a fixed request rate and reports throughput, latency, memory and GC.
+//
+//   harness --recordings test/recordings --qps 200 --duration 10 engine.js
+//
+// Arrivals follow a fixed schedule and upstream latency and errors are
+// derived from --seed and each request's search and position in it, so two
+// runs issue the same requests and see the same upstream behaviour.
+// --max-p99, --min-qps and --max-error-rate turn the report into a
+// pass/fail gate.
+
+#include "js/builtins.hpp"
+#include "js/error.hpp"
+#include "js/http.hpp"
+#include "js/jsc.hpp"
+#include "mock_server.hpp"
+#include "util/log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace {
+
+using namespace lany;
+using clock = std::chrono::steady_clock;
+
+struct config {
+    std::string recordings = "test/recordings";
+    std::string queries;
+    double qps = 100;
+    double duration = 10;
+    double drain = 30;
+    bench::mock_server::options upstream;
+    double max_p99_ms = 0;
+    double min_qps = 0;
+    double max_error_rate = -1;
+    std::vector<std::string> files;
+};
+
+struct engine_stats {
+    std::string name;
+    uint64_t ok = 0;
+    uint64_t failed = 0;
+    std::vector<double> latency_ms;
+};
+
+const char *const default_queries[] = {
+    "linux",         "weather",       "c++ coroutines", "quickjs",
+    "privacy",       "metasearch",    "rust vs go",     "recipes",
+    "news",          "translate",     "maps",           "open source",
+    "unicode nfkc",  "http/2",        "wikipedia",      "searx",
+};
+
+void usage() {
+    std::fprintf(
+        stderr,
+        "usage: harness [options] engine.js...\n"
+        "  --recordings DIR     recorded upstream responses\n"
+        "  --queries FILE       one query per line\n"
+        "  --qps N              target request rate (default 100)\n"
+        "  --duration S         seconds of load (default 10)\n"
+        "  --seed N             upstream latency/error seed (default 1)\n"
+        "  --latency MS         base upstream latency (default 20)\n"
+        "  --jitter MS          mean of the latency tail (default 10)\n"
+        "  --error-rate F       share of upstream 503s (default 0.01)\n"
+        "  --max-p99 MS         fail if p99 latency exceeds MS\n"
+        "  --min-qps N          fail if throughput is below N\n"
+        "  --max-error-rate F   fail if more searches fail\n");
+}
+
+bool parse_args(int argc, char **argv, config &cfg) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            cfg.files.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *val = argv[++i];
+        if (arg == "--recordings")
+            cfg.recordings = val;
+        else if (arg == "--queries")
+            cfg.queries = val;
+        else if (arg == "--qps")
+            cfg.qps = std::atof(val);
+        else if (arg == "--duration")
+            cfg.duration = std::atof(val);
+        else if (arg == "--seed")
+            cfg.upstream.seed = std::strtoull(val, nullptr, 10);
+        else if (arg == "--latency")
+            cfg.upstream.latency_ms = std::atof(val);
+        else if (arg == "--jitter")
+            cfg.upstream.jitter_ms = std::atof(val);
+        else if (arg == "--error-rate")
+            cfg.upstream.error_rate = std::atof(val);
+        else if (arg == "--max-p99")
+            cfg.max_p99_ms = std::atof(val);
+        else if (arg == "--min-qps")
+            cfg.min_qps = std::atof(val);
+        else if (arg == "--max-error-rate")
+            cfg.max_error_rate = std::atof(val);
+        else
+            return false;
+    }
+    return !cfg.files.empty() && cfg.qps > 0 && cfg.duration > 0;
+}
+
+std::vector<std::string> load_queries(const std::string &path) {
+    std::vector<std::string> ret;
+    if (!path.empty()) {
+        std::ifstream file(path);
+        for (std::string line; std::getline(file, line);)
+            if (!line.empty())
+                ret.push_back(line);
+    }
+    if (ret.empty())
+        ret.assign(std::begin(default_queries), std::end(default_queries));
+    return ret;
+}
+
+// nearest-rank percentile of sorted samples
+double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    size_t rank = static_cast<size_t>(p / 100 * sorted.size());
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+void print_latency(const char *label, std::vector<double> &samples) {
+    std::sort(samples.begin(), samples.end());
+    std::printf("%-22s p50 %8.2f  p90 %8.2f  p99 %8.2f  p99.9 %8.2f  "
+                "max %8.2f ms\n",
+                label, percentile(samples, 50), percentile(samples, 90),
+                percentile(samples, 99), percentile(samples, 99.9),
+                samples.empty() ? 0 : samples.back());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    config cfg;
+    if (!parse_args(argc, argv, cfg)) {
+        usage();
+        return 2;
+    }
+
+    bench::mock_server upstream(cfg.upstream);
+    int recordings = upstream.load(cfg.recordings);
+    if (recordings < 0 || upstream.start() < 0) {
+        std::fprintf(stderr, "could not start mock upstream\n");
+        return 1;
+    }
+    js::set_http_upstream("127.0.0.1", upstream.port());
+
+    js::register_builtin_modules();
+
+    js::Core core;
+    core.prefetch(cfg.files);
+    for (auto &file : cfg.files)
+        if (core.add_file(file) < 0)
+            return 1;
+    // let the scripts finish registering before the clock starts
+    while (core.run_slice() > 0)
+        ;
+
+    auto names = core.engines();
+    if (names.empty()) {
+        std::fprintf(stderr, "no engine registered\n");
+        return 1;
+    }
+    std::vector<engine_stats> engines(names.size());
+    for (size_t i = 0; i < names.size(); i++)
+        engines[i].name = names[i];
+    auto queries = load_queries(cfg.queries);
+
+    // open loop: request k is due at start + k / qps no matter how fast
+    // earlier ones completed, and its latency is measured from that time
+    auto interval = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(1.0 / cfg.qps));
+    uint64_t total = static_cast<uint64_t>(cfg.qps * cfg.duration);
+    uint64_t sent = 0, completed = 0;
+    auto start = clock::now();
+    auto due_at = [&](uint64_t k) -> clock::time_point {
+        return start + interval * static_cast<int64_t>(k);
+    };
+    auto give_up = start + std::chrono::duration_cast<clock::duration>(
+                               std::chrono::duration<double>(cfg.duration +
+                                                             cfg.drain));
+
+    while (completed < total) {
+        auto now = clock::now();
+        if (now > give_up)
+            break;
+        while (sent < total && due_at(sent) <= now) {
+            size_t e = sent % engines.size();
+            auto &query = queries[(sent / engines.size()) % queries.size()];
+            auto due = due_at(sent);
+            auto record = [&, e, due](bool ok, std::string) {
+                auto &s = engines[e];
+                (ok ? s.ok : s.failed)++;
+                s.latency_ms.push_back(
+                    std::chrono::duration<double, std::milli>(clock::now() -
+                                                              due)
+                        .count());
+                completed++;
+            };
+            // the upstream derives its answers from this number
+            if (core.search(engines[e].name, query, record, sent) < 0)
+                record(false, {});
+            sent++;
+        }
+
+        int busy = core.run_slice();
+        if (busy == 0) {
+            core.get_gc().idle();
+            auto next = sent < total ? due_at(sent) : clock::time_point::max();
+            std::this_thread::sleep_until(
+                std::min(next, clock::now() + std::chrono::microseconds(200)));
+        }
+    }
+    double elapsed =
+        std::chrono::duration<double>(clock::now() - start).count();
+
+    uint64_t ok = 0, failed = 0;
+    std::vector<double> all;
+    std::printf("engines                %zu\n", engines.size());
+    std::printf("recordings             %d\n", recordings);
+    std::printf("target rate            %.1f req/s for %.1f s\n", cfg.qps,
+                cfg.duration);
+    for (auto &s : engines) {
+        ok += s.ok;
+        failed += s.failed;
+        all.insert(all.end(), s.latency_ms.begin(), s.latency_ms.end());
+    }
+    std::printf("requests               %llu sent, %llu completed, "
+                "%llu ok, %llu failed\n",
+                (unsigned long long)sent, (unsigned long long)completed,
+                (unsigned long long)ok, (unsigned long long)failed);
+    double throughput = completed / elapsed;
+    std::printf("throughput             %.1f req/s\n", throughput);
+    print_latency("latency", all);
+    double p99 = percentile(all, 99);
+    for (auto &s : engines) {
+        std::string label = "  " + s.name;
+        print_latency(label.c_str(), s.latency_ms);
+    }
+
+    for (auto &count : core.error_counts())
+        std::printf("  %-20s %-10s %llu errors\n", count.engine.c_str(),
+                    js::category_name(count.category),
+                    (unsigned long long)count.count);
+
+    auto up = upstream.get_stats();
+    std::printf("upstream               %llu requests, %llu errors, "
+                "%llu without recording\n",
+                (unsigned long long)up.requests,
+                (unsigned long long)up.errors,
+                (unsigned long long)up.misses);
+
+    auto &gc = core.get_gc();
+    auto &gs = gc.stats();
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    std::printf("js heap                %zu bytes, %llu allocated total\n",
+                gc.heap_size(), (unsigned long long)gc.allocated());
+    std::printf("max rss                %ld KiB\n", usage.ru_maxrss);
+    std::printf("gc                     %llu idle runs, %llu skipped, "
+                "pause total %.2f ms, max %.2f ms\n",
+                (unsigned long long)gs.idle_runs,
+                (unsigned long long)gs.skipped,
+                std::chrono::duration<double, std::milli>(gs.total_pause)
+                    .count(),
+                std::chrono::duration<double, std::milli>(gs.max_pause)
+                    .count());
+    util::log::flush();
+
+    int ret = 0;
+    double error_rate = sent ? double(failed + sent - completed) / sent : 0;
+    if (completed < sent) {
+        std::printf("FAIL: %llu searches did not complete\n",
+                    (unsigned long long)(sent - completed));
+        ret = 1;
+    }
+    if (cfg.max_p99_ms > 0 && p99 > cfg.max_p99_ms) {
+        std::printf("FAIL: p99 %.2f ms > %.2f ms\n", p99, cfg.max_p99_ms);
+        ret = 1;
+    }
+    if (cfg.min_qps > 0 && throughput < cfg.min_qps) {
+        std::printf("FAIL: throughput %.1f < %.1f req/s\n", throughput,
+                    cfg.min_qps);
+        ret = 1;
+    }
+    if (cfg.max_error_rate >= 0 && error_rate > cfg.max_error_rate) {
+        std::printf("FAIL: error rate %.4f > %.4f\n", error_rate,
+                    cfg.max_error_rate);
+        ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,288 @@
+#include "mock_server.hpp"
+#include "util/hash_ring.hpp"
+#include "util/log.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using namespace lany;
+using clock = std::chrono::steady_clock;
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+// uniform in [0, 1)
+double unit(uint64_t x) { return (x >> 11) * 0x1.0p-53; }
+
+std::string content_type(const std::filesystem::path &path) {
+    auto ext = path.extension().string();
+    if (ext == ".json")
+        return "application/json";
+    if (ext == ".html" || ext == ".htm")
+        return "text/html; charset=utf-8";
+    if (ext == ".xml")
+        return "application/xml";
+    if (ext == ".txt")
+        return "text/plain; charset=utf-8";
+    return "application/octet-stream";
+}
+
+std::string make_response(int status, std::string_view reason,
+                          std::string_view type, std::string_view body) {
+    std::string out = "HTTP/1.1 " + std::to_string(status) + " ";
+    out.append(reason);
+    out += "\r\nContent-Type: ";
+    out.append(type);
+    out += "\r\nContent-Length: " + std::to_string(body.size()) +
+           "\r\nConnection: close\r\n\r\n";
+    out.append(body);
+    return out;
+}
+
+// The "X-Replay-Key: <search>.<fetch>" header of a request head, or the
+// default key if absent.
+util::replay_key parse_replay_key(std::string_view head) {
+    constexpr std::string_view name = "\r\nx-replay-key:";
+    util::replay_key key;
+    for (size_t pos = head.find("\r\n"); pos != std::string_view::npos;
+         pos = head.find("\r\n", pos + 2)) {
+        auto line = head.substr(pos, name.size());
+        if (line.size() == name.size() &&
+            std::equal(line.begin(), line.end(), name.begin(),
+                       [](char a, char b) { return std::tolower(a) == b; })) {
+            char *end;
+            key.search = std::strtoll(head.data() + pos + name.size(), &end,
+                                      10);
+            if (*end == '.')
+                key.fetch = std::strtoul(end + 1, nullptr, 10);
+            break;
+        }
+    }
+    return key;
+}
+
+struct connection {
+    int fd = -1;
+    std::string in{};
+    std::string out{};
+    size_t written = 0;
+    bool responded = false;
+    clock::time_point due{};
+};
+
+} // namespace
+
+namespace lany {
+namespace bench {
+
+mock_server::mock_server(const options &opts) : opts(opts) {}
+
+mock_server::~mock_server() { stop(); }
+
+int mock_server::load(const std::string &dir) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(dir, ec);
+         !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file())
+            continue;
+        std::ifstream file(it->path(), std::ios::in | std::ios::binary);
+        recording rec{content_type(it->path()),
+                      {std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>()}};
+        auto key = fs::relative(it->path(), dir).replace_extension();
+        recordings[key.generic_string()] = std::move(rec);
+    }
+    if (ec) {
+        LANY_LOG_ERROR("could not read recordings {}: {}", dir, ec.message());
+        return -1;
+    }
+    return static_cast<int>(recordings.size());
+}
+
+mock_server::plan
+mock_server::plan_for(std::string_view target,
+                      const util::replay_key &key) const noexcept {
+    uint64_t h = util::hash64(target) ^ splitmix64(opts.seed) ^
+                 splitmix64(splitmix64(key.search) + key.fetch);
+    plan ret;
+    ret.delay_ms = opts.latency_ms -
+                   opts.jitter_ms * std::log(1.0 - unit(splitmix64(h)));
+    ret.error = unit(splitmix64(h + 1)) < opts.error_rate;
+    return ret;
+}
+
+std::string mock_server::respond(std::string_view target,
+                                 const util::replay_key &key,
+                                 double &delay_ms) {
+    n_requests++;
+    auto p = plan_for(target, key);
+    delay_ms = p.delay_ms;
+    if (p.error) {
+        n_errors++;
+        return make_response(503, "Service Unavailable", "text/plain", "");
+    }
+
+    std::string path(target.substr(0, target.find('?')));
+    path.erase(0, path.find_first_not_of('/'));
+    if (path.empty() || path.back() == '/')
+        path += "index";
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos && path.find('/', dot) == std::string::npos)
+        path.resize(dot);
+
+    auto it = recordings.find(path);
+    if (it == recordings.end()) {
+        n_misses++;
+        LANY_LOG_DEBUG("no recording for {}", target);
+        return make_response(404, "Not Found", "text/plain", "");
+    }
+    return make_response(200, "OK", it->second.content_type,
+                         it->second.body);
+}
+
+int mock_server::start() {
+    listen_fd =
+        ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        return -1;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), len) < 0 ||
+        ::listen(listen_fd, SOMAXCONN) < 0 ||
+        ::getsockname(listen_fd, reinterpret_cast<sockaddr *>(&addr), &len) <
+            0 ||
+        ::pipe2(wake_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        stop();
+        return -1;
+    }
+    bound_port = ntohs(addr.sin_port);
+    thread = std::thread(&mock_server::run, this);
+    return 0;
+}
+
+void mock_server::stop() {
+    if (thread.joinable()) {
+        char c = 0;
+        (void)::write(wake_fds[1], &c, 1);
+        thread.join();
+    }
+    for (int *fd : {&listen_fd, &wake_fds[0], &wake_fds[1]}) {
+        if (*fd >= 0)
+            ::close(*fd);
+        *fd = -1;
+    }
+}
+
+mock_server::stats mock_server::get_stats() const noexcept {
+    return {n_requests.load(), n_errors.load(), n_misses.load()};
+}
+
+void mock_server::run() {
+    std::vector<connection> conns;
+    std::vector<pollfd> fds;
+    while (true) {
+        auto now = clock::now();
+        auto next = clock::time_point::max();
+        fds.assign({{wake_fds[0], POLLIN, 0}, {listen_fd, POLLIN, 0}});
+        for (auto &conn : conns) {
+            short events = POLLIN;
+            if (conn.responded)
+                events = conn.due <= now ? POLLOUT : 0;
+            if (conn.responded && conn.due > now)
+                next = std::min(next, conn.due);
+            fds.push_back({conn.fd, events, 0});
+        }
+        int timeout = -1;
+        if (next != clock::time_point::max())
+            timeout = static_cast<int>(
+                std::chrono::ceil<std::chrono::milliseconds>(next - now)
+                    .count());
+        if (::poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR)
+            break;
+        if (fds[0].revents)
+            break;
+
+        if (fds[1].revents & POLLIN) {
+            int fd;
+            while ((fd = ::accept4(listen_fd, nullptr, nullptr,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+                conns.push_back({fd});
+        }
+
+        now = clock::now();
+        size_t polled = fds.size() - 2;
+        for (size_t i = 0; i < conns.size(); i++) {
+            auto &conn = conns[i];
+            short revents = i < polled ? fds[i + 2].revents : 0;
+            if (!conn.responded && revents) {
+                char buf[4096];
+                ssize_t n;
+                while ((n = ::recv(conn.fd, buf, sizeof(buf), 0)) > 0)
+                    conn.in.append(buf, n);
+                if (conn.in.find("\r\n\r\n") != std::string::npos) {
+                    // "GET <target> HTTP/1.1"
+                    std::string_view head(conn.in);
+                    head = head.substr(0, head.find("\r\n\r\n"));
+                    size_t start = head.find(' ');
+                    size_t end = head.find(' ', start + 1);
+                    double delay_ms = 0;
+                    if (end == std::string::npos)
+                        conn.out = make_response(400, "Bad Request",
+                                                 "text/plain", "");
+                    else
+                        conn.out = respond(
+                            head.substr(start + 1, end - start - 1),
+                            parse_replay_key(head), delay_ms);
+                    conn.due = now + std::chrono::microseconds(
+                                         static_cast<int64_t>(delay_ms * 1000));
+                    conn.responded = true;
+                } else if (n == 0 || (n < 0 && errno != EAGAIN)) {
+                    ::close(conn.fd);
+                    conn.fd = -1;
+                    continue;
+                }
+            }
+            if (conn.responded && conn.due <= now) {
+                ssize_t n = ::send(conn.fd, conn.out.data() + conn.written,
+                                   conn.out.size() - conn.written,
+                                   MSG_NOSIGNAL);
+                if (n > 0)
+                    conn.written += n;
+                if (conn.written == conn.out.size() ||
+                    (n < 0 && errno != EAGAIN)) {
+                    ::close(conn.fd);
+                    conn.fd = -1;
+                }
+            }
+        }
+        std::erase_if(conns, [](auto &conn) { return conn.fd < 0; });
+    }
+    for (auto &conn : conns)
+        ::close(conn.fd);
+}
+
+} // namespace bench
+} // namespace lany
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "util/http_client.hpp"
+
+namespace lany {
+namespace bench {
+
+// Local HTTP/1.1 server replaying recorded upstream responses.
+//
+// Recordings are files below one directory, keyed by their path without
+// extension: "example.com/search.html" answers "/example.com/search?q=x".
+// A request for a directory path ("/example.com/") looks for "index".
+//
+// Latency and failures are drawn from a hash of the seed, the target and
+// the "X-Replay-Key" header the redirecting http_client sends (the search a
+// request belongs to and its position within it), not from a shared
+// generator or arrival order, so a run replays identically regardless of
+// how concurrent requests interleave. Requests without the header hash the
+// target alone.
+class mock_server {
+public:
+    struct options {
+        uint64_t seed = 1;
+        // every response waits `latency_ms` plus an exponential tail with
+        // mean `jitter_ms`
+        double latency_ms = 20;
+        double jitter_ms = 10;
+        // share of requests answered with 503
+        double error_rate = 0.01;
+    };
+
+    // How a request is answered, before the body is looked up.
+    struct plan {
+        double delay_ms;
+        bool error; // answered with 503
+    };
+
+    struct stats {
+        uint64_t requests = 0;
+        uint64_t errors = 0;
+        uint64_t misses = 0;
+    };
+
+private:
+    struct recording {
+        std::string content_type;
+        std::string body;
+    };
+    options opts;
+    std::unordered_map<std::string, recording> recordings;
+    std::thread thread;
+    int listen_fd = -1;
+    int wake_fds[2] = {-1, -1};
+    uint16_t bound_port = 0;
+    std::atomic<uint64_t> n_requests{0}, n_errors{0}, n_misses{0};
+
+    void run();
+    std::string respond(std::string_view target, const util::replay_key &key,
+                        double &delay_ms);
+
+public:
+    mock_server(const options &opts);
+    mock_server(const mock_server &) = delete;
+    ~mock_server();
+
+    // Loads every file below `dir`. Returns the number of recordings or -1.
+    int load(const std::string &dir);
+    // Listens on 127.0.0.1 with an ephemeral port.
+    int start();
+    void stop();
+    plan plan_for(std::string_view target,
+                  const util::replay_key &key) const noexcept;
+    inline uint16_t port() const noexcept { return bound_port; }
+    stats get_stats() const noexcept;
+};
+
+} // namespace bench
+} // namespace lany
@@ -0,0 +1,190 @@
+#include "protocol.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+struct FrameHeader {
+    uint32_t size;
+    uint8_t type;
+    uint8_t flags;
+    uint16_t reserved;
+    uint64_t id;
+};
+static_assert(sizeof(FrameHeader) == 16);
+
+bool make_addr(const std::string &path, sockaddr_un &addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+} // namespace
+
+namespace lany {
+namespace ipc {
+
+void PayloadWriter::put_u32(uint32_t val) {
+    out.append(reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+void PayloadWriter::put_str(std::string_view str) {
+    put_u32(static_cast<uint32_t>(str.size()));
+    out.append(str);
+}
+
+bool PayloadReader::get_u32(uint32_t &val) {
+    if (in.size() - pos < sizeof(val))
+        return false;
+    std::memcpy(&val, in.data() + pos, sizeof(val));
+    pos += sizeof(val);
+    return true;
+}
+
+bool PayloadReader::get_str(std::string_view &str) {
+    uint32_t len;
+    if (!get_u32(len) || in.size() - pos < len)
+        return false;
+    str = in.substr(pos, len);
+    pos += len;
+    return true;
+}
+
+int listen_unix(const std::string &path) {
+    sockaddr_un addr;
+    if (!make_addr(path, addr))
+        return -1;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        ::listen(fd, 8) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connect_unix(const std::string &path) {
+    sockaddr_un addr;
+    if (!make_addr(path, addr))
+        return -1;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int send_frame(int fd, const Frame &frame) {
+    if (frame.payload.size() > max_frame_size)
+        return -1;
+    FrameHeader header{static_cast<uint32_t>(frame.payload.size()),
+                       static_cast<uint8_t>(frame.type), frame.flags, 0,
+                       frame.id};
+    iovec iov[2] = {{&header, sizeof(header)},
+                    {const_cast<char *>(frame.payload.data()),
+                     frame.payload.size()}};
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    while (msg.msg_iovlen > 0) {
+        ssize_t n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            // EPIPE and ECONNRESET land here once the peer died
+            return -1;
+        }
+        while (msg.msg_iovlen > 0 &&
+               static_cast<size_t>(n) >= msg.msg_iov->iov_len) {
+            n -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            auto &cur = *msg.msg_iov;
+            cur.iov_base = static_cast<char *>(cur.iov_base) + n;
+            cur.iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+int FrameReader::fill(int fd) {
+    char tmp[16384];
+    while (true) {
+        ssize_t n = ::recv(fd, tmp, sizeof(tmp), MSG_DONTWAIT);
+        if (n > 0) {
+            buf.append(tmp, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        return -1;
+    }
+}
+
+int FrameReader::next(Frame &frame) {
+    if (buf.size() - pos < sizeof(FrameHeader))
+        return 0;
+    FrameHeader header;
+    std::memcpy(&header, buf.data() + pos, sizeof(header));
+    if (header.size > max_frame_size)
+        return -1;
+    if (buf.size() - pos - sizeof(header) < header.size)
+        return 0;
+    frame.type = static_cast<FrameType>(header.type);
+    frame.flags = header.flags;
+    frame.id = header.id;
+    frame.payload.assign(buf, pos + sizeof(header), header.size);
+    pos += sizeof(header) + header.size;
+    if (pos == buf.size()) {
+        buf.clear();
+        pos = 0;
+    } else if (pos > buf.size() / 2) {
+        buf.erase(0, pos);
+        pos = 0;
+    }
+    return 1;
+}
+
+int FrameReader::wait(int fd, Frame &frame, int timeout_ms) {
+    using clock = std::chrono::steady_clock;
+    auto deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+        int ret = next(frame);
+        if (ret != 0)
+            return ret;
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(
+            deadline - clock::now());
+        if (left.count() <= 0)
+            return 0;
+        pollfd pfd{fd, POLLIN, 0};
+        int n = ::poll(&pfd, 1, static_cast<int>(left.count()));
+        if (n < 0 && errno != EINTR)
+            return -1;
+        if (n > 0 && fill(fd) < 0)
+            return next(frame) == 1 ? 1 : -1;
+    }
+}
+
+} // namespace ipc
+} // namespace lany
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace lany {
+namespace ipc {
+
+// Frames exchanged between a coordinator and its shard workers over a Unix
+// domain socket. Both ends run on the same host, so integers use the native
+// byte order.
+//
+//   uint32 size | uint8 type | uint8 flags | uint16 reserved | uint64 id
+//   payload (size bytes)
+//
+// Payloads are sequences of uint32 counts and length-prefixed strings:
+//   hello     count, engine names    worker -> coordinator on connect
+//   query     engine, query          coordinator -> worker
+//   result    engine, data           worker -> coordinator, id of the query
+//   shutdown  (empty)                coordinator -> worker
+enum class FrameType : uint8_t {
+    hello = 1,
+    query = 2,
+    result = 3,
+    shutdown = 4,
+};
+
+constexpr uint8_t flag_ok = 1 << 0;
+constexpr uint8_t flag_cached = 1 << 1;
+constexpr uint32_t max_frame_size = 64 << 20;
+
+// Every member has a default, so `Frame{FrameType::query}` is complete.
+struct Frame {
+    FrameType type{};
+    uint8_t flags = 0;
+    uint64_t id = 0;
+    std::string payload{};
+};
+
+class PayloadWriter {
+    std::string &out;
+
+public:
+    PayloadWriter(std::string &out) : out(out) {}
+    void put_u32(uint32_t val);
+    void put_str(std::string_view str);
+};
+
+class PayloadReader {
+    std::string_view in;
+    size_t pos = 0;
+
+public:
+    PayloadReader(std::string_view in) : in(in) {}
+    bool get_u32(uint32_t &val);
+    bool get_str(std::string_view &str);
+};
+
+// Reassembles frames from a socket without blocking the caller, so a slow
+// or stalled peer cannot hold up the loop that owns the connection.
+class FrameReader {
+    std::string buf;
+    size_t pos = 0;
+
+public:
+    // Reads whatever is available. Returns -1 on error or once the peer has
+    // closed the connection; frames read before that can still be taken.
+    int fill(int fd);
+    // Takes the next complete frame. Returns 1 if one was available, 0 if
+    // more input is needed and -1 if the stream is malformed.
+    int next(Frame &frame);
+    // Waits up to `timeout_ms` for a frame. Returns 1 when one was read, 0
+    // on timeout and -1 on error.
+    int wait(int fd, Frame &frame, int timeout_ms);
+};
+
+int listen_unix(const std::string &path);
+int connect_unix(const std::string &path);
+// Fails with -1 instead of raising SIGPIPE when the peer is gone.
+int send_frame(int fd, const Frame &frame);
+
+} // namespace ipc
+} // namespace lany
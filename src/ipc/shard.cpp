@@ -0,0 +1,365 @@
+#include "shard.hpp"
+#include "util/log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+std::string cache_key(std::string_view engine, std::string_view query) {
+    std::string key;
+    key.reserve(engine.size() + query.size() + 1);
+    key.append(engine);
+    key.push_back('\0');
+    key.append(query);
+    return key;
+}
+
+} // namespace
+
+namespace lany {
+namespace ipc {
+
+ResultCache::ResultCache(size_t capacity,
+                         std::chrono::steady_clock::duration ttl)
+    : capacity(capacity), ttl(ttl) {}
+
+const ResultCache::Entry *ResultCache::find(const std::string &key) {
+    auto it = index.find(key);
+    if (it == index.end())
+        return nullptr;
+    if (it->second->expires <= std::chrono::steady_clock::now()) {
+        entries.erase(it->second);
+        index.erase(it);
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, it->second);
+    return &*it->second;
+}
+
+void ResultCache::put(const std::string &key, bool ok, std::string payload) {
+    if (capacity == 0)
+        return;
+    auto expires = std::chrono::steady_clock::now() + ttl;
+    if (auto it = index.find(key); it != index.end()) {
+        it->second->ok = ok;
+        it->second->payload = std::move(payload);
+        it->second->expires = expires;
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+    if (entries.size() >= capacity) {
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+    entries.push_front({key, ok, std::move(payload), expires});
+    index.emplace(key, entries.begin());
+}
+
+ShardWorker::ShardWorker() : ShardWorker(Options{}) {}
+ShardWorker::ShardWorker(const Options &opts)
+    : cache(opts.cache_entries, opts.cache_ttl) {}
+ShardWorker::~ShardWorker() {
+    if (fd >= 0)
+        ::close(fd);
+}
+
+int ShardWorker::add_file(const std::string_view &filename) noexcept {
+    return core.add_file(filename);
+}
+
+void ShardWorker::reply(uint64_t id, const std::string &engine, bool ok,
+                        const std::string &data, bool cached) noexcept {
+    Frame frame{FrameType::result};
+    frame.id = id;
+    frame.flags = (ok ? flag_ok : 0) | (cached ? flag_cached : 0);
+    PayloadWriter writer(frame.payload);
+    writer.put_str(engine);
+    writer.put_str(data);
+    if (send_frame(fd, frame) < 0) {
+        LANY_LOG_ERROR("shard: failed to send result {}", id);
+        running = false;
+    }
+}
+
+int ShardWorker::handle(const Frame &frame) noexcept {
+    switch (frame.type) {
+    case FrameType::shutdown:
+        running = false;
+        return 0;
+    case FrameType::query:
+        break;
+    default:
+        LANY_LOG_WARN("shard: unexpected frame type {}",
+                      static_cast<int>(frame.type));
+        return -1;
+    }
+
+    PayloadReader reader(frame.payload);
+    std::string_view engine_view, query_view;
+    if (!reader.get_str(engine_view) || !reader.get_str(query_view))
+        return -1;
+    std::string engine(engine_view), query(query_view);
+    std::string key = cache_key(engine, query);
+    if (auto hit = cache.find(key)) {
+        reply(frame.id, engine, hit->ok, hit->payload, true);
+        return 0;
+    }
+
+    uint64_t id = frame.id;
+    int ret = core.search(engine, query,
+                          [this, id, engine, key](bool ok, std::string data) {
+                              reply(id, engine, ok, data, false);
+                              // errors are not cached so they are retried
+                              if (ok)
+                                  cache.put(key, ok, std::move(data));
+                          });
+    if (ret < 0)
+        reply(id, engine, false, "unknown engine", false);
+    return 0;
+}
+
+int ShardWorker::run(const std::string &socket_path) noexcept {
+    fd = connect_unix(socket_path);
+    if (fd < 0) {
+        LANY_LOG_ERROR("shard: could not connect to {}", socket_path);
+        return -1;
+    }
+    // let the scripts finish registering their engines
+    while (core.run_slice() > 0)
+        ;
+
+    Frame hello{FrameType::hello};
+    auto names = core.engines();
+    PayloadWriter writer(hello.payload);
+    writer.put_u32(static_cast<uint32_t>(names.size()));
+    for (auto &name : names)
+        writer.put_str(name);
+    if (send_frame(fd, hello) < 0)
+        return -1;
+
+    int ret = 0;
+    int busy = 0;
+    running = true;
+    while (running) {
+        // keep the engines moving while jobs are queued, poll briefly while
+        // only worker threads are outstanding, otherwise block until the
+        // coordinator sends something
+        int timeout = busy > 0 ? 0 : core.has_pending() ? 1 : -1;
+        pollfd pfd{fd, POLLIN, 0};
+        int n = ::poll(&pfd, 1, timeout);
+        if (n < 0 && errno != EINTR) {
+            ret = -1;
+            break;
+        }
+        if (n > 0) {
+            // a partial frame stays buffered until the rest arrives
+            int err = reader.fill(fd);
+            Frame frame;
+            int got = 0;
+            while (running && (got = reader.next(frame)) > 0) {
+                if (handle(frame) < 0)
+                    LANY_LOG_WARN("shard: malformed frame {}", frame.id);
+            }
+            if (err < 0 || got < 0) {
+                // the coordinator went away
+                ret = running && got < 0 ? -1 : 0;
+                break;
+            }
+        }
+        busy = core.run_slice();
+        if (busy < 0)
+            ret = -1;
+        else if (busy == 0 && !core.has_pending())
+            core.get_gc().idle();
+    }
+    ::close(fd);
+    fd = -1;
+    return ret;
+}
+
+Coordinator::~Coordinator() {
+    for (auto &shard : shards)
+        if (shard.fd >= 0)
+            ::close(shard.fd);
+    if (listen_fd >= 0)
+        ::close(listen_fd);
+}
+
+int Coordinator::listen(const std::string &socket_path) noexcept {
+    listen_fd = listen_unix(socket_path);
+    if (listen_fd < 0) {
+        LANY_LOG_ERROR("coordinator: could not listen on {}", socket_path);
+        return -1;
+    }
+    return 0;
+}
+
+int Coordinator::accept_shard(int timeout_ms) noexcept {
+    int fd;
+    do
+        fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    while (fd < 0 && errno == EINTR);
+    if (fd < 0)
+        return -1;
+
+    Shard shard{fd, {}, {}};
+    Frame frame;
+    uint32_t count;
+    if (shard.reader.wait(fd, frame, timeout_ms) <= 0 ||
+        frame.type != FrameType::hello) {
+        LANY_LOG_WARN("coordinator: shard did not say hello");
+        ::close(fd);
+        return -1;
+    }
+    PayloadReader reader(frame.payload);
+    if (!reader.get_u32(count)) {
+        ::close(fd);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        std::string_view name;
+        if (!reader.get_str(name)) {
+            ::close(fd);
+            return -1;
+        }
+        shard.engines.emplace_back(name);
+    }
+
+    uint32_t index = static_cast<uint32_t>(shards.size());
+    LANY_LOG_INFO("coordinator: shard {} hosts {} engines", index,
+                  shard.engines.size());
+    shards.push_back(std::move(shard));
+    ring.add(index);
+    return 0;
+}
+
+std::vector<std::string> Coordinator::engines() const {
+    std::vector<std::string> names;
+    for (auto &shard : shards) {
+        if (shard.fd < 0)
+            continue;
+        for (auto &name : shard.engines)
+            if (std::find(names.begin(), names.end(), name) == names.end())
+                names.push_back(name);
+    }
+    return names;
+}
+
+bool Coordinator::hosts(uint32_t shard,
+                        const std::string &engine) const noexcept {
+    auto &names = shards[shard].engines;
+    return shards[shard].fd >= 0 &&
+           std::find(names.begin(), names.end(), engine) != names.end();
+}
+
+void Coordinator::drop_shard(uint32_t shard) noexcept {
+    ::close(shards[shard].fd);
+    shards[shard].fd = -1;
+    ring.remove(shard);
+    for (auto it = pending.begin(); it != pending.end();) {
+        if (it->second.shard == shard) {
+            auto done = std::move(it->second.done);
+            auto engine = std::move(it->second.engine);
+            it = pending.erase(it);
+            done(engine, false, "shard disconnected");
+        } else
+            ++it;
+    }
+}
+
+int Coordinator::route(const std::string &engine, const std::string &query,
+                       ResultCallback done) noexcept {
+    int64_t shard = ring.lookup(cache_key(engine, query), [&](uint32_t node) {
+        return hosts(node, engine);
+    });
+    if (shard < 0)
+        return -1;
+
+    Frame frame{FrameType::query};
+    frame.id = next_id++;
+    PayloadWriter writer(frame.payload);
+    writer.put_str(engine);
+    writer.put_str(query);
+    if (send_frame(shards[shard].fd, frame) < 0) {
+        LANY_LOG_WARN("coordinator: lost shard {}", shard);
+        drop_shard(static_cast<uint32_t>(shard));
+        return route(engine, query, std::move(done));
+    }
+    pending.emplace(frame.id, Pending{static_cast<uint32_t>(shard), engine,
+                                      std::move(done)});
+    return 0;
+}
+
+int Coordinator::search(const std::string &query,
+                        const ResultCallback &done) noexcept {
+    int started = 0;
+    for (auto &engine : engines())
+        if (route(engine, query, done) == 0)
+            started++;
+    return started;
+}
+
+int Coordinator::poll(int timeout_ms) noexcept {
+    std::vector<pollfd> fds;
+    std::vector<uint32_t> owners;
+    for (uint32_t i = 0; i < shards.size(); i++) {
+        if (shards[i].fd < 0)
+            continue;
+        fds.push_back({shards[i].fd, POLLIN, 0});
+        owners.push_back(i);
+    }
+    if (pending.empty() || fds.empty())
+        return static_cast<int>(pending.size());
+
+    int n = ::poll(fds.data(), fds.size(), timeout_ms);
+    if (n < 0)
+        return errno == EINTR ? static_cast<int>(pending.size()) : -1;
+
+    for (size_t i = 0; i < fds.size() && n > 0; i++) {
+        if (fds[i].revents == 0)
+            continue;
+        n--;
+        auto &shard = shards[owners[i]];
+        int err = shard.reader.fill(fds[i].fd);
+        Frame frame;
+        int got = 0;
+        while ((got = shard.reader.next(frame)) > 0)
+            dispatch(frame);
+        if (err < 0 || got < 0) {
+            LANY_LOG_WARN("coordinator: lost shard {}", owners[i]);
+            drop_shard(owners[i]);
+        }
+    }
+    return static_cast<int>(pending.size());
+}
+
+void Coordinator::dispatch(const Frame &frame) noexcept {
+    auto it = pending.find(frame.id);
+    if (frame.type != FrameType::result || it == pending.end())
+        return;
+    PayloadReader reader(frame.payload);
+    std::string_view engine, data;
+    auto entry = std::move(it->second);
+    pending.erase(it);
+    if (!reader.get_str(engine) || !reader.get_str(data))
+        entry.done(entry.engine, false, "malformed result");
+    else
+        entry.done(entry.engine, frame.flags & flag_ok, std::string(data));
+}
+
+void Coordinator::shutdown() noexcept {
+    for (uint32_t i = 0; i < shards.size(); i++) {
+        if (shards[i].fd < 0)
+            continue;
+        send_frame(shards[i].fd, Frame{FrameType::shutdown});
+        drop_shard(i);
+    }
+}
+
+} // namespace ipc
+} // namespace lany
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "js/jsc.hpp"
+#include "protocol.hpp"
+#include "util/hash_ring.hpp"
+
+namespace lany {
+namespace ipc {
+
+// Bounded LRU of settled searches, each entry valid for `ttl`.
+class ResultCache {
+    struct Entry {
+        std::string key;
+        bool ok;
+        std::string payload;
+        std::chrono::steady_clock::time_point expires;
+    };
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t capacity;
+    std::chrono::steady_clock::duration ttl;
+
+public:
+    ResultCache(size_t capacity, std::chrono::steady_clock::duration ttl);
+
+    const Entry *find(const std::string &key);
+    void put(const std::string &key, bool ok, std::string payload);
+};
+
+// Hosts a subset of engines in its own Core and serves the queries a
+// Coordinator routes to it. Engine scripts are loaded with add_file as in
+// single process mode and need no changes.
+class ShardWorker {
+public:
+    struct Options {
+        size_t cache_entries = 1024;
+        std::chrono::seconds cache_ttl{300};
+    };
+
+private:
+    js::Core core;
+    ResultCache cache;
+    FrameReader reader;
+    int fd = -1;
+    bool running = false;
+
+    int handle(const Frame &frame) noexcept;
+    void reply(uint64_t id, const std::string &engine, bool ok,
+               const std::string &data, bool cached) noexcept;
+
+public:
+    ShardWorker();
+    ShardWorker(const Options &opts);
+    ShardWorker(const ShardWorker &) = delete;
+    ~ShardWorker();
+
+    inline js::Core &get_core() noexcept { return core; }
+
+    int add_file(const std::string_view &filename) noexcept;
+    // Connects to the coordinator listening on `socket_path`, announces the
+    // hosted engines and serves queries until it is told to shut down.
+    int run(const std::string &socket_path) noexcept;
+};
+
+// Routes queries to the shard workers connected to it. A (engine, query)
+// pair always lands on the same shard among those hosting the engine, so
+// each shard's result cache holds a disjoint partition of the keys.
+class Coordinator {
+public:
+    using ResultCallback =
+        std::function<void(const std::string &engine, bool ok,
+                           std::string payload)>;
+
+private:
+    struct Shard {
+        int fd;
+        std::vector<std::string> engines;
+        FrameReader reader;
+    };
+    struct Pending {
+        uint32_t shard;
+        std::string engine;
+        ResultCallback done;
+    };
+    std::vector<Shard> shards;
+    std::unordered_map<uint64_t, Pending> pending;
+    util::hash_ring ring;
+    int listen_fd = -1;
+    uint64_t next_id = 1;
+
+    bool hosts(uint32_t shard, const std::string &engine) const noexcept;
+    void drop_shard(uint32_t shard) noexcept;
+    void dispatch(const Frame &frame) noexcept;
+
+public:
+    Coordinator() = default;
+    Coordinator(const Coordinator &) = delete;
+    ~Coordinator();
+
+    int listen(const std::string &socket_path) noexcept;
+    // Blocks until one more shard has connected, then waits up to
+    // `timeout_ms` for its hello.
+    int accept_shard(int timeout_ms = 10000) noexcept;
+    std::vector<std::string> engines() const;
+
+    // Sends `query` to the shard owning (engine, query). Returns -1 if no
+    // connected shard hosts `engine`.
+    int route(const std::string &engine, const std::string &query,
+              ResultCallback done) noexcept;
+    // Fans `query` out to every known engine; returns the number of
+    // searches started.
+    int search(const std::string &query, const ResultCallback &done) noexcept;
+    // Waits up to `timeout_ms` (-1 = forever) for results and dispatches
+    // them. Returns the number of searches still outstanding or -1.
+    int poll(int timeout_ms) noexcept;
+    void shutdown() noexcept;
+};
+
+} // namespace ipc
+} // namespace lany
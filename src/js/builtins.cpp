@@ -0,0 +1,24 @@
+#include "builtins.hpp"
+#include "decompress.hpp"
+#include "engine.hpp"
+#include "error.hpp"
+#include "http.hpp"
+#include "result_batch.hpp"
+#include "text.hpp"
+#include "worker.hpp"
+
+namespace lany {
+namespace js {
+
+void register_builtin_modules() {
+    register_engine_module();
+    register_error_module();
+    register_http_module();
+    register_worker_module();
+    register_decompress_module();
+    register_result_module();
+    register_text_module();
+}
+
+} // namespace js
+} // namespace lany
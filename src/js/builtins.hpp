@@ -0,0 +1,11 @@
+#pragma once
+
+namespace lany {
+namespace js {
+
+// Registers every "searxpp:*" builtin module. Runs once at startup, before
+// the first runtime is created.
+void register_builtin_modules();
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,152 @@
+#include "decompress.hpp"
+#include "module.hpp"
+#include "util/buffer_pool.hpp"
+#include "util/decoder.hpp"
+
+#include <memory>
+
+#include <quickjs.h>
+
+namespace {
+
+using namespace lany;
+
+struct DecoderState {
+    std::unique_ptr<util::decoder> dec;
+    util::encoding enc;
+    util::pooled_buffer out;
+};
+
+auto decoder_class = std::make_shared<js::Class>("Decoder");
+
+DecoderState *get_state(JSContext *ctx, JSValueConst val) {
+    return static_cast<DecoderState *>(
+        JS_GetOpaque2(ctx, val, decoder_class->get_class_id()));
+}
+
+void free_pooled(JSRuntime *, void *opaque, void *ptr) {
+    util::buffer_pool::global().release(
+        static_cast<uint8_t *>(ptr), reinterpret_cast<uintptr_t>(opaque));
+}
+
+// Hands the decoded bytes over to a new ArrayBuffer without copying them.
+JSValue take_output(JSContext *ctx, DecoderState *state) {
+    size_t size, capacity;
+    uint8_t *data = state->out.release(size, capacity);
+    if (!data)
+        return JS_NewArrayBufferCopy(ctx, nullptr, 0);
+    JSValue ab =
+        JS_NewArrayBuffer(ctx, data, size, free_pooled,
+                          reinterpret_cast<void *>(capacity), false);
+    if (JS_IsException(ab))
+        util::buffer_pool::global().release(data, capacity);
+    return ab;
+}
+
+void js_decoder_finalizer(JSRuntime *rt, JSValue val) {
+    delete static_cast<DecoderState *>(
+        JS_GetOpaque(val, decoder_class->get_class_id()));
+}
+
+JSValue js_create_decoder(JSContext *ctx, JSValueConst this_val, int argc,
+                          JSValueConst *argv) {
+    util::encoding enc = util::encoding::identity;
+    if (argc > 0 && !JS_IsUndefined(argv[0]) && !JS_IsNull(argv[0])) {
+        size_t len;
+        const char *name = JS_ToCStringLen(ctx, &len, argv[0]);
+        if (!name)
+            return JS_EXCEPTION;
+        bool ok = util::parse_encoding({name, len}, enc);
+        JSValue err = ok ? JS_UNDEFINED
+                         : JS_ThrowTypeError(ctx, "unsupported encoding: %s",
+                                             name);
+        JS_FreeCString(ctx, name);
+        if (!ok)
+            return err;
+    }
+
+    JSValue obj = JS_NewObjectClass(ctx, decoder_class->get_class_id());
+    if (JS_IsException(obj))
+        return obj;
+    JS_SetOpaque(obj, new DecoderState{util::decoder::create(enc), enc, {}});
+    return obj;
+}
+
+JSValue js_decoder_push(JSContext *ctx, JSValueConst this_val, int argc,
+                        JSValueConst *argv) {
+    auto state = get_state(ctx, this_val);
+    if (!state)
+        return JS_EXCEPTION;
+    if (argc < 1)
+        return JS_ThrowTypeError(ctx, "push expects an ArrayBuffer");
+
+    size_t size;
+    const uint8_t *data = JS_GetArrayBuffer(ctx, &size, argv[0]);
+    if (!data) {
+        // not an ArrayBuffer, try a TypedArray or DataView view
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        size_t offset, bytes_per_element;
+        JSValue ab = JS_GetTypedArrayBuffer(ctx, argv[0], &offset, &size,
+                                            &bytes_per_element);
+        if (JS_IsException(ab))
+            return ab;
+        data = JS_GetArrayBuffer(ctx, &bytes_per_element, ab);
+        JS_FreeValue(ctx, ab);
+        if (!data)
+            return JS_EXCEPTION;
+        data += offset;
+    }
+
+    if (state->dec->update(data, size, state->out) < 0)
+        return JS_ThrowTypeError(ctx, "decode failed: %s",
+                                 state->dec->error().c_str());
+    return JS_NewInt64(ctx, state->out.size());
+}
+
+JSValue js_decoder_take(JSContext *ctx, JSValueConst this_val, int argc,
+                        JSValueConst *argv) {
+    auto state = get_state(ctx, this_val);
+    if (!state)
+        return JS_EXCEPTION;
+    return take_output(ctx, state);
+}
+
+JSValue js_decoder_finish(JSContext *ctx, JSValueConst this_val, int argc,
+                          JSValueConst *argv) {
+    auto state = get_state(ctx, this_val);
+    if (!state)
+        return JS_EXCEPTION;
+    if (state->enc != util::encoding::identity && !state->dec->finished())
+        return JS_ThrowTypeError(ctx, "truncated compressed stream");
+    return take_output(ctx, state);
+}
+
+JSValue js_decoder_get_finished(JSContext *ctx, JSValueConst this_val) {
+    auto state = get_state(ctx, this_val);
+    if (!state)
+        return JS_EXCEPTION;
+    return JS_NewBool(ctx, state->dec->finished());
+}
+
+} // namespace
+
+namespace lany {
+namespace js {
+
+void register_decompress_module() {
+    decoder_class->set_finalizer(js_decoder_finalizer);
+    decoder_class->add_fn("push", js_decoder_push, 1);
+    decoder_class->add_fn("take", js_decoder_take);
+    decoder_class->add_fn("finish", js_decoder_finish);
+    decoder_class->add_getset("finished", js_decoder_get_finished, nullptr);
+
+    Module module;
+    module.add_prop("acceptEncoding",
+                    std::string_view(util::accept_encoding));
+    module.add_fn("createDecoder", js_create_decoder, 1);
+    module.add_obj("Decoder", decoder_class);
+    register_module("searxpp:decompress", module);
+}
+
+} // namespace js
+} // namespace lany
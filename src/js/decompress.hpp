@@ -0,0 +1,19 @@
+#pragma once
+
+namespace lany {
+namespace js {
+
+// Registers the "searxpp:decompress" builtin module.
+//
+//   import { acceptEncoding, createDecoder } from "searxpp:decompress";
+//   const d = createDecoder(res.headers["content-encoding"]);
+//   for (const chunk of chunks) d.push(chunk);
+//   const body = d.finish();  // ArrayBuffer
+//
+// Chunks are decoded as they are pushed, so decoding overlaps with the
+// rest of the body still being received. Output accumulates in a pooled
+// native buffer that is handed to JS as an ArrayBuffer without a copy.
+void register_decompress_module();
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,273 @@
+#include "engine.hpp"
+#include "error.hpp"
+#include "module.hpp"
+#include "result_batch.hpp"
+#include "util/log.hpp"
+
+#include <array>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+using namespace lany;
+
+struct EngineEntry {
+    std::string name;
+    JSContext *ctx;
+    JSValue fn;
+    uint32_t log_id;
+    // failed searches per error category
+    std::array<uint64_t, js::error_category_count> errors{};
+};
+
+struct PendingSearch {
+    size_t engine; // index into Registry::engines
+    int64_t search;
+    js::SearchCallback done;
+};
+
+// Engines and in-flight searches of one runtime. Only the thread running
+// the runtime touches its registry; the mutex guards the map itself.
+struct Registry {
+    std::vector<EngineEntry> engines;
+    std::unordered_map<uint64_t, PendingSearch> pending;
+    uint64_t next_id = 0;
+    // requests made so far by each numbered search in flight
+    std::unordered_map<int64_t, uint32_t> fetches;
+    js::ActiveSearch active;
+};
+
+std::mutex registry_mtx;
+std::unordered_map<JSRuntime *, Registry> registry_map;
+
+std::mutex log_ids_mtx;
+std::unordered_map<std::string, uint32_t> log_ids;
+
+Registry &get_registry(JSRuntime *rt) {
+    std::lock_guard lock(registry_mtx);
+    return registry_map[rt];
+}
+
+// Like get_registry, but does not create one for runtimes without engines.
+Registry *find_registry(JSRuntime *rt) {
+    std::lock_guard lock(registry_mtx);
+    auto it = registry_map.find(rt);
+    return it == registry_map.end() ? nullptr : &it->second;
+}
+
+// Counts a failed search and reports it without rendering a stack.
+void fail_search(JSContext *ctx, EngineEntry &engine, JSValueConst val,
+                 js::SearchCallback &done) {
+    js::ErrorInfo info;
+    js::set_error_engine(ctx, val, engine.name);
+    std::string msg = js::describe_error(ctx, val, &info);
+    engine.errors[static_cast<size_t>(info.category)]++;
+    LANY_LOG(WARN, engine.log_id, "search failed: {}", msg);
+    done(false, std::move(msg));
+}
+
+// magic: 1 when called as the fulfillment handler, 0 for rejection
+JSValue js_engine_settle(JSContext *ctx, JSValueConst this_val, int argc,
+                         JSValueConst *argv, int magic, JSValue *func_data) {
+    auto &reg = get_registry(JS_GetRuntime(ctx));
+    int64_t id;
+    JS_ToInt64(ctx, &id, func_data[0]);
+    auto it = reg.pending.find(id);
+    if (it == reg.pending.end())
+        return JS_UNDEFINED;
+    auto search = std::move(it->second);
+    auto &done = search.done;
+    auto &engine = reg.engines[search.engine];
+    reg.pending.erase(it);
+    reg.fetches.erase(search.search);
+
+    JSValueConst val = argc > 0 ? argv[0] : JS_UNDEFINED;
+    if (!magic) {
+        fail_search(ctx, engine, val, done);
+        return JS_UNDEFINED;
+    }
+    std::string payload;
+    int batch = js::write_ranked_batch(ctx, val, payload);
+    size_t size;
+    uint8_t *buf = batch == 0 ? JS_WriteObject(ctx, &size, val, 0) : nullptr;
+    if (batch < 0 || (batch == 0 && !buf)) {
+        JSValue exn = JS_GetException(ctx);
+        fail_search(ctx, engine, exn, done);
+        JS_FreeValue(ctx, exn);
+        return JS_UNDEFINED;
+    }
+    if (buf) {
+        payload.assign(reinterpret_cast<char *>(buf), size);
+        js_free(ctx, buf);
+    }
+    done(true, std::move(payload));
+    return JS_UNDEFINED;
+}
+
+JSValue js_engine_register(JSContext *ctx, JSValueConst this_val, int argc,
+                           JSValueConst *argv) {
+    if (argc < 2 || !JS_IsFunction(ctx, argv[1]))
+        return JS_ThrowTypeError(ctx, "register expects a name and function");
+    const char *name = JS_ToCString(ctx, argv[0]);
+    if (!name)
+        return JS_EXCEPTION;
+    std::string engine = name;
+    JS_FreeCString(ctx, name);
+
+    auto &reg = get_registry(JS_GetRuntime(ctx));
+    for (const auto &entry : reg.engines) {
+        if (entry.name == engine)
+            return JS_ThrowTypeError(ctx, "engine %s already registered",
+                                     engine.c_str());
+    }
+    uint32_t log_id = js::engine_log_id(engine);
+    reg.engines.push_back({engine, ctx, JS_DupValue(ctx, argv[1]), log_id});
+    LANY_LOG(INFO, log_id, "register engine: {}", engine);
+    return JS_UNDEFINED;
+}
+
+} // namespace
+
+namespace lany {
+namespace js {
+
+void register_engine_module() {
+    Module module;
+    module.add_fn("register", js_engine_register, 2);
+    register_module("searxpp:engine", module);
+}
+
+std::vector<std::string> engine_names(JSRuntime *rt) {
+    std::vector<std::string> ret;
+    for (const auto &entry : get_registry(rt).engines)
+        ret.push_back(entry.name);
+    return ret;
+}
+
+JSContext *engine_context(JSRuntime *rt, const std::string &engine) noexcept {
+    for (const auto &entry : get_registry(rt).engines) {
+        if (entry.name == engine)
+            return entry.ctx;
+    }
+    return nullptr;
+}
+
+int start_search(JSRuntime *rt, const std::string &engine,
+                 const std::string &query, SearchCallback done,
+                 int64_t search) noexcept {
+    auto &reg = get_registry(rt);
+    size_t index = reg.engines.size();
+    for (size_t i = 0; i < reg.engines.size(); i++) {
+        if (reg.engines[i].name == engine)
+            index = i;
+    }
+    if (index == reg.engines.size())
+        return -1;
+
+    // the search function may register engines and move the entries
+    JSContext *ctx = reg.engines[index].ctx;
+    JSValue arg = JS_NewStringLen(ctx, query.data(), query.size());
+    auto outer = reg.active;
+    reg.active = {search, reg.engines[index].log_id};
+    JSValue ret = JS_Call(ctx, reg.engines[index].fn, JS_UNDEFINED, 1, &arg);
+    reg.active = outer;
+    JS_FreeValue(ctx, arg);
+    if (JS_IsException(ret)) {
+        reg.fetches.erase(search);
+        JSValue exn = JS_GetException(ctx);
+        fail_search(ctx, reg.engines[index], exn, done);
+        JS_FreeValue(ctx, exn);
+        return 0;
+    }
+
+    // Promise.resolve(ret).then(settle_ok, settle_err)
+    uint64_t id = ++reg.next_id;
+    JSValue id_val = JS_NewInt64(ctx, id);
+    JSValue handlers[2] = {
+        JS_NewCFunctionData(ctx, js_engine_settle, 1, 1, 1, &id_val),
+        JS_NewCFunctionData(ctx, js_engine_settle, 1, 0, 1, &id_val)};
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue promise_ctor = JS_GetPropertyStr(ctx, global, "Promise");
+    JSValue resolve = JS_GetPropertyStr(ctx, promise_ctor, "resolve");
+    JSValue promise = JS_Call(ctx, resolve, promise_ctor, 1, &ret);
+    JSValue then = JS_GetPropertyStr(ctx, promise, "then");
+    reg.pending.emplace(id, PendingSearch{index, search, std::move(done)});
+    JSValue chained = JS_Call(ctx, then, promise, 2, handlers);
+    if (JS_IsException(chained)) {
+        auto it = reg.pending.find(id);
+        JSValue exn = JS_GetException(ctx);
+        if (it != reg.pending.end()) {
+            fail_search(ctx, reg.engines[index], exn, it->second.done);
+            reg.pending.erase(it);
+            reg.fetches.erase(search);
+        }
+        JS_FreeValue(ctx, exn);
+    }
+    JS_FreeValue(ctx, chained);
+    JS_FreeValue(ctx, then);
+    JS_FreeValue(ctx, promise);
+    JS_FreeValue(ctx, resolve);
+    JS_FreeValue(ctx, promise_ctor);
+    JS_FreeValue(ctx, global);
+    JS_FreeValue(ctx, handlers[0]);
+    JS_FreeValue(ctx, handlers[1]);
+    JS_FreeValue(ctx, ret);
+    return 0;
+}
+
+uint32_t engine_log_id(const std::string &engine) noexcept {
+    std::lock_guard lock(log_ids_mtx);
+    auto it = log_ids.find(engine);
+    if (it != log_ids.end())
+        return it->second;
+    if (log_ids.size() >= util::log::max_engines)
+        return util::log::no_engine;
+    uint32_t id = static_cast<uint32_t>(log_ids.size());
+    log_ids.emplace(engine, id);
+    return id;
+}
+
+ActiveSearch active_search(JSRuntime *rt) noexcept {
+    auto reg = find_registry(rt);
+    return reg ? reg->active : ActiveSearch{};
+}
+
+void set_active_search(JSRuntime *rt, const ActiveSearch &search) noexcept {
+    if (auto reg = find_registry(rt))
+        reg->active = search;
+}
+
+uint32_t next_fetch(JSRuntime *rt, int64_t search) noexcept {
+    auto reg = find_registry(rt);
+    return reg ? reg->fetches[search]++ : 0;
+}
+
+std::vector<ErrorCount> error_counts(JSRuntime *rt) {
+    std::vector<ErrorCount> ret;
+    for (const auto &entry : get_registry(rt).engines) {
+        for (size_t i = 0; i < error_category_count; i++) {
+            if (entry.errors[i])
+                ret.push_back({entry.name, static_cast<ErrorCategory>(i),
+                               entry.errors[i]});
+        }
+    }
+    return ret;
+}
+
+void release_engines(JSRuntime *rt) noexcept {
+    Registry reg;
+    {
+        std::lock_guard lock(registry_mtx);
+        auto it = registry_map.find(rt);
+        if (it == registry_map.end())
+            return;
+        reg = std::move(it->second);
+        registry_map.erase(it);
+    }
+    for (auto &entry : reg.engines)
+        JS_FreeValue(entry.ctx, entry.fn);
+}
+
+} // namespace js
+} // namespace lany
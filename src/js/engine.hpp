@@ -0,0 +1,69 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <quickjs.h>
+
+#include "error.hpp"
+#include "util/log.hpp"
+
+namespace lany {
+namespace js {
+
+// Called once a search settles. On success `payload` holds the engine's
+// results in JS_WriteObject format, otherwise the rendered error.
+using SearchCallback = std::function<void(bool ok, std::string payload)>;
+
+// Registers the "searxpp:engine" builtin module through which engine
+// scripts announce themselves:
+//
+//   import { register } from "searxpp:engine";
+//   register("example", async (query) => [{ url, title, content }]);
+//
+// A search may also return a ResultBatch from "searxpp:result". Its payload
+// is then the ranked columns, see read_ranked_batch.
+void register_engine_module();
+
+std::vector<std::string> engine_names(JSRuntime *rt);
+// The context `engine` was registered from, or nullptr.
+JSContext *engine_context(JSRuntime *rt, const std::string &engine) noexcept;
+// Starts `engine`'s search function; `done` runs from a later job once the
+// returned value or promise settles. Returns -1 if the engine is unknown.
+// `search` is the caller's number for it, or -1; see active_search.
+int start_search(JSRuntime *rt, const std::string &engine,
+                 const std::string &query, SearchCallback done,
+                 int64_t search = -1) noexcept;
+
+// Log id of `engine`, the same in every runtime of the process, under which
+// its records are tagged and sampled (see util::log::set_sample_rate).
+// util::log::no_engine once max_engines names have been handed out.
+uint32_t engine_log_id(const std::string &engine) noexcept;
+
+struct ActiveSearch {
+    // the caller's number for the search, or -1
+    int64_t search = -1;
+    uint32_t engine = util::log::no_engine;
+
+    explicit operator bool() const noexcept {
+        return search >= 0 || engine != util::log::no_engine;
+    }
+};
+// The search whose code `rt` is running. Set while the search function runs
+// and, through poll_workers, while the continuation of a native promise it
+// created runs, so requests and their failures can be attributed to their
+// search without asking engine scripts for it.
+ActiveSearch active_search(JSRuntime *rt) noexcept;
+void set_active_search(JSRuntime *rt, const ActiveSearch &search) noexcept;
+// Position of the next request among those made by `search`.
+uint32_t next_fetch(JSRuntime *rt, int64_t search) noexcept;
+// Failed searches per engine and error category. Counted on the runtime's
+// own thread, like everything else in its registry.
+std::vector<ErrorCount> error_counts(JSRuntime *rt);
+// Frees the registered engine functions of `rt`; must run before it is
+// freed.
+void release_engines(JSRuntime *rt) noexcept;
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,305 @@
+#include "error.hpp"
+#include "module.hpp"
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace {
+
+using namespace lany;
+
+constexpr const char *category_names[js::error_category_count] = {
+    "upstream", "parse", "timeout", "script", "internal"};
+
+struct ErrorState {
+    js::ErrorInfo info;
+    // Error object holding the backtrace, if one was captured
+    JSValue captured = JS_UNDEFINED;
+};
+
+// Chains the EngineError prototype to Error.prototype, so `instanceof Error`
+// holds for EngineErrors.
+class ErrorClass : public js::Class {
+public:
+    using Class::Class;
+
+    JSValue to_js_value(JSContext *ctx) override {
+        JSValue proto = Class::to_js_value(ctx);
+        if (JS_IsException(proto))
+            return proto;
+        JSValue global = JS_GetGlobalObject(ctx);
+        JSValue ctor = JS_GetPropertyStr(ctx, global, "Error");
+        JSValue parent = JS_GetPropertyStr(ctx, ctor, "prototype");
+        int err = JS_SetPrototype(ctx, proto, parent);
+        JS_FreeValue(ctx, parent);
+        JS_FreeValue(ctx, ctor);
+        JS_FreeValue(ctx, global);
+        if (err < 0) {
+            JS_FreeValue(ctx, proto);
+            return JS_EXCEPTION;
+        }
+        return proto;
+    }
+};
+
+auto error_class = std::make_shared<ErrorClass>("EngineError");
+std::atomic<uint32_t> sample_every{64};
+
+ErrorState *get_state(JSValueConst val) {
+    return static_cast<ErrorState *>(
+        JS_GetOpaque(val, error_class->get_class_id()));
+}
+
+std::string to_string(JSContext *ctx, JSValueConst val) {
+    size_t len;
+    const char *str = JS_ToCStringLen(ctx, &len, val);
+    if (!str) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return {};
+    }
+    std::string ret(str, len);
+    JS_FreeCString(ctx, str);
+    return ret;
+}
+
+// Codes are hashed into a fixed number of counters, so scripts making up
+// codes cannot grow it; codes sharing a slot share their samples.
+bool sampled(const std::string &code) {
+    thread_local std::array<uint32_t, 256> seen{};
+    uint32_t n = sample_every.load(std::memory_order_relaxed);
+    auto &count = seen[std::hash<std::string>{}(code) % seen.size()];
+    return n != 0 && count++ % n == 0;
+}
+
+JSValue capture_stack(JSContext *ctx) {
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue ctor = JS_GetPropertyStr(ctx, global, "Error");
+    JSValue err = JS_CallConstructor(ctx, ctor, 0, nullptr);
+    JS_FreeValue(ctx, ctor);
+    JS_FreeValue(ctx, global);
+    if (JS_IsException(err)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return JS_UNDEFINED;
+    }
+    return err;
+}
+
+void js_error_finalizer(JSRuntime *rt, JSValue val) {
+    auto state = get_state(val);
+    if (!state)
+        return;
+    JS_FreeValueRT(rt, state->captured);
+    delete state;
+}
+
+void js_error_gc_mark(JSRuntime *rt, JSValueConst val,
+                      JS_MarkFunc *mark_func) {
+    if (auto state = get_state(val))
+        JS_MarkValue(rt, state->captured, mark_func);
+}
+
+// Installs the EngineError prototype in contexts that have not imported
+// the module.
+bool ensure_proto(JSContext *ctx) {
+    JSClassID id = error_class->get_class_id();
+    if (JS_IsRegisteredClass(JS_GetRuntime(ctx), id)) {
+        JSValue proto = JS_GetClassProto(ctx, id);
+        bool found = JS_IsObject(proto);
+        JS_FreeValue(ctx, proto);
+        if (found)
+            return true;
+    }
+    JSValue proto = error_class->to_js_value(ctx);
+    if (JS_IsException(proto))
+        return false;
+    JS_FreeValue(ctx, proto);
+    return true;
+}
+
+JSValue wrap_error(JSContext *ctx, std::unique_ptr<ErrorState> state) {
+    if (!ensure_proto(ctx))
+        return JS_EXCEPTION;
+    JSValue obj = JS_NewObjectClass(ctx, error_class->get_class_id());
+    if (JS_IsException(obj)) {
+        JS_FreeValue(ctx, state->captured);
+        return obj;
+    }
+    JS_SetOpaque(obj, state.release());
+    return obj;
+}
+
+JSValue js_error_fail(JSContext *ctx, JSValueConst this_val, int argc,
+                      JSValueConst *argv) {
+    if (argc < 3)
+        return JS_ThrowTypeError(ctx,
+                                 "fail expects a category, code and message");
+    auto state = std::make_unique<ErrorState>();
+    std::string category = to_string(ctx, argv[0]);
+    if (!js::parse_category(category, state->info.category))
+        return JS_ThrowTypeError(ctx, "unknown error category: %s",
+                                 category.c_str());
+    state->info.code = to_string(ctx, argv[1]);
+    state->info.message = to_string(ctx, argv[2]);
+
+    bool want_stack = false;
+    if (argc > 3 && JS_IsObject(argv[3])) {
+        JSValue val = JS_GetPropertyStr(ctx, argv[3], "stack");
+        want_stack = JS_ToBool(ctx, val) > 0;
+        JS_FreeValue(ctx, val);
+    }
+    if (want_stack || sampled(state->info.code))
+        state->captured = capture_stack(ctx);
+    return wrap_error(ctx, std::move(state));
+}
+
+JSValue js_error_is_engine_error(JSContext *ctx, JSValueConst this_val,
+                                 int argc, JSValueConst *argv) {
+    return JS_NewBool(ctx, argc > 0 && get_state(argv[0]) != nullptr);
+}
+
+template <int field>
+JSValue js_error_get_field(JSContext *ctx, JSValueConst this_val) {
+    auto state = static_cast<ErrorState *>(
+        JS_GetOpaque2(ctx, this_val, error_class->get_class_id()));
+    if (!state)
+        return JS_EXCEPTION;
+    auto &info = state->info;
+    const std::string &str = field == 0   ? info.code
+                             : field == 1 ? info.message
+                                          : info.engine;
+    return JS_NewStringLen(ctx, str.data(), str.size());
+}
+
+JSValue js_error_get_category(JSContext *ctx, JSValueConst this_val) {
+    auto state = static_cast<ErrorState *>(
+        JS_GetOpaque2(ctx, this_val, error_class->get_class_id()));
+    if (!state)
+        return JS_EXCEPTION;
+    return JS_NewString(ctx, js::category_name(state->info.category));
+}
+
+JSValue js_error_get_stack(JSContext *ctx, JSValueConst this_val) {
+    auto state = static_cast<ErrorState *>(
+        JS_GetOpaque2(ctx, this_val, error_class->get_class_id()));
+    if (!state)
+        return JS_EXCEPTION;
+    if (JS_IsUndefined(state->captured))
+        return JS_UNDEFINED;
+    return JS_GetPropertyStr(ctx, state->captured, "stack");
+}
+
+JSValue js_error_to_string(JSContext *ctx, JSValueConst this_val, int argc,
+                           JSValueConst *argv) {
+    if (!JS_GetOpaque2(ctx, this_val, error_class->get_class_id()))
+        return JS_EXCEPTION;
+    std::string str = "EngineError " + js::describe_error(ctx, this_val);
+    return JS_NewStringLen(ctx, str.data(), str.size());
+}
+
+} // namespace
+
+namespace lany {
+namespace js {
+
+const char *category_name(ErrorCategory category) noexcept {
+    auto index = static_cast<size_t>(category);
+    return index < error_category_count ? category_names[index] : "unknown";
+}
+
+bool parse_category(std::string_view name, ErrorCategory &category) noexcept {
+    for (size_t i = 0; i < error_category_count; i++) {
+        if (name == category_names[i]) {
+            category = static_cast<ErrorCategory>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void register_error_module() {
+    error_class->set_finalizer(js_error_finalizer);
+    error_class->set_gc_marker(js_error_gc_mark);
+    error_class->add_getset("category", js_error_get_category, nullptr);
+    error_class->add_getset("code", js_error_get_field<0>, nullptr);
+    error_class->add_getset("message", js_error_get_field<1>, nullptr);
+    error_class->add_getset("engine", js_error_get_field<2>, nullptr);
+    error_class->add_getset("stack", js_error_get_stack, nullptr);
+    error_class->add_fn("toString", js_error_to_string);
+    error_class->add_prop("name", std::string_view("EngineError"),
+                          JS_PROP_CONFIGURABLE | JS_PROP_WRITABLE);
+
+    Module module;
+    module.add_fn("fail", js_error_fail, 4);
+    module.add_fn("isEngineError", js_error_is_engine_error, 1);
+    module.add_obj("EngineError", error_class);
+    register_module("searxpp:error", module);
+}
+
+JSValue new_engine_error(JSContext *ctx, ErrorCategory category,
+                         std::string code, std::string message) {
+    auto state = std::make_unique<ErrorState>();
+    state->info.category = category;
+    state->info.code = std::move(code);
+    state->info.message = std::move(message);
+    if (sampled(state->info.code))
+        state->captured = capture_stack(ctx);
+    return wrap_error(ctx, std::move(state));
+}
+
+bool get_engine_error(JSContext *ctx, JSValueConst val, ErrorInfo &info) {
+    auto state = get_state(val);
+    if (!state)
+        return false;
+    info = state->info;
+    return true;
+}
+
+void set_error_engine(JSContext *ctx, JSValueConst val,
+                      const std::string &engine) {
+    auto state = get_state(val);
+    if (state && state->info.engine.empty())
+        state->info.engine = engine;
+}
+
+std::string render_stack(JSContext *ctx, JSValueConst val) {
+    JSValueConst holder = val;
+    if (auto state = get_state(val))
+        holder = state->captured;
+    else if (!JS_IsError(ctx, val))
+        return {};
+    if (!JS_IsObject(holder))
+        return {};
+    JSValue stack = JS_GetPropertyStr(ctx, holder, "stack");
+    std::string ret = JS_IsUndefined(stack) ? "" : to_string(ctx, stack);
+    JS_FreeValue(ctx, stack);
+    return ret;
+}
+
+std::string describe_error(JSContext *ctx, JSValueConst val,
+                           ErrorInfo *info) {
+    ErrorInfo local;
+    if (!info)
+        info = &local;
+    if (get_engine_error(ctx, val, *info)) {
+        std::string ret = category_name(info->category);
+        ret += ':';
+        ret += info->code;
+        ret += ": ";
+        ret += info->message;
+        return ret;
+    }
+    info->category = ErrorCategory::script;
+    info->message = to_string(ctx, val);
+    if (info->message.empty())
+        info->message = "unknown exception";
+    return info->message;
+}
+
+void set_stack_sampling(uint32_t n) noexcept {
+    sample_every.store(n, std::memory_order_relaxed);
+}
+
+} // namespace js
+} // namespace lany
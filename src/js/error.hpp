@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <quickjs.h>
+
+namespace lany {
+namespace js {
+
+enum class ErrorCategory : uint8_t {
+    upstream, // the upstream failed or answered with an error status
+    parse,    // the upstream response could not be understood
+    timeout,
+    script, // anything thrown that is not an EngineError
+    internal,
+};
+constexpr size_t error_category_count = 5;
+
+const char *category_name(ErrorCategory category) noexcept;
+bool parse_category(std::string_view name, ErrorCategory &category) noexcept;
+
+struct ErrorInfo {
+    ErrorCategory category = ErrorCategory::script;
+    std::string code;
+    std::string message;
+    std::string engine;
+};
+
+struct ErrorCount {
+    std::string engine;
+    ErrorCategory category;
+    uint64_t count;
+};
+
+// Registers the "searxpp:error" builtin module.
+//
+//   import { fail, isEngineError } from "searxpp:error";
+//   throw fail("parse", "bad-json", "unexpected token", { stack: true });
+//
+// EngineErrors are native objects inheriting from Error.prototype: creating,
+// throwing and counting one never builds a backtrace or converts it to a
+// string. A stack is captured for one in every `n` errors of each code (see
+// set_stack_sampling) or when asked for with `{ stack: true }`, and rendered
+// only when read.
+void register_error_module();
+
+// Creates an EngineError from native code, e.g. for a failed request. Works
+// in contexts that never imported "searxpp:error".
+JSValue new_engine_error(JSContext *ctx, ErrorCategory category,
+                         std::string code, std::string message);
+
+// Fills `info` from an EngineError without calling into JS. Returns false
+// for any other value.
+bool get_engine_error(JSContext *ctx, JSValueConst val, ErrorInfo &info);
+// Records the engine a rejected search belonged to on an EngineError.
+void set_error_engine(JSContext *ctx, JSValueConst val,
+                      const std::string &engine);
+// Captured stack of an EngineError or Error, or empty if none was taken.
+std::string render_stack(JSContext *ctx, JSValueConst val);
+// Category and code separated by ':', followed by the message; converts
+// plain exceptions to a string only when they are not EngineErrors.
+std::string describe_error(JSContext *ctx, JSValueConst val,
+                           ErrorInfo *info = nullptr);
+
+// Capture a stack for one in `n` EngineErrors of each code; 0 disables
+// sampling. Defaults to 64.
+void set_stack_sampling(uint32_t n) noexcept;
+
+} // namespace js
+} // namespace lany
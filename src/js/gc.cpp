@@ -0,0 +1,174 @@
+#include "gc.hpp"
+#include "util/log.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+namespace {
+
+constexpr size_t malloc_overhead = 8;
+
+size_t usable_size(const void *ptr) {
+#if defined(__APPLE__)
+    return malloc_size(ptr);
+#elif defined(_WIN32)
+    return _msize(const_cast<void *>(ptr));
+#else
+    return malloc_usable_size(const_cast<void *>(ptr));
+#endif
+}
+
+} // namespace
+
+namespace lany {
+namespace js {
+
+// Same bookkeeping as the QuickJS default allocator, plus a running total
+// of allocated bytes.
+void *GcManager::js_gc_malloc(JSMallocState *s, size_t size) {
+    if (s->malloc_size + size > s->malloc_limit)
+        return nullptr;
+    void *ptr = std::malloc(size);
+    if (!ptr)
+        return nullptr;
+    size_t real = usable_size(ptr);
+    s->malloc_count++;
+    s->malloc_size += real + malloc_overhead;
+    // JS_NewRuntime2 allocates the runtime through a temporary state, so
+    // the pointer is refreshed on every call rather than cached once
+    auto gc = static_cast<GcManager *>(s->opaque);
+    gc->state = s;
+    gc->allocated_bytes += real;
+    return ptr;
+}
+
+void GcManager::js_gc_free(JSMallocState *s, void *ptr) {
+    if (!ptr)
+        return;
+    s->malloc_count--;
+    s->malloc_size -= usable_size(ptr) + malloc_overhead;
+    std::free(ptr);
+}
+
+void *GcManager::js_gc_realloc(JSMallocState *s, void *ptr, size_t size) {
+    if (!ptr)
+        return size == 0 ? nullptr : js_gc_malloc(s, size);
+    size_t old_size = usable_size(ptr);
+    if (size == 0) {
+        js_gc_free(s, ptr);
+        return nullptr;
+    }
+    if (s->malloc_size + size - old_size > s->malloc_limit)
+        return nullptr;
+    ptr = std::realloc(ptr, size);
+    if (!ptr)
+        return nullptr;
+    size_t real = usable_size(ptr);
+    s->malloc_size += real - old_size;
+    if (real > old_size)
+        static_cast<GcManager *>(s->opaque)->allocated_bytes +=
+            real - old_size;
+    return ptr;
+}
+
+size_t GcManager::js_gc_malloc_usable_size(const void *ptr) {
+    return usable_size(ptr);
+}
+
+const JSMallocFunctions GcManager::malloc_functions = {
+    js_gc_malloc, js_gc_free, js_gc_realloc, js_gc_malloc_usable_size};
+
+GcManager::GcManager() : GcManager(Options{}) {}
+GcManager::GcManager(const Options &opts)
+    : opts(opts), headroom(opts.min_headroom), rate_start(clock::now()) {}
+
+void GcManager::attach(JSRuntime *rt) {
+    this->rt = rt;
+    _stats.live_bytes = heap_size();
+    rate_bytes = allocated_bytes;
+    rate_start = clock::now();
+    update_threshold();
+}
+
+size_t GcManager::heap_size() const {
+    if (state)
+        return state->malloc_size;
+    if (!rt)
+        return 0;
+    JSMemoryUsage usage;
+    JS_ComputeMemoryUsage(rt, &usage);
+    return usage.malloc_size;
+}
+
+void GcManager::update_rate() {
+    auto now = clock::now();
+    std::chrono::duration<double> elapsed = now - rate_start;
+    if (elapsed.count() <= 0 || !state)
+        return;
+    double rate = (allocated_bytes - rate_bytes) / elapsed.count();
+    // smooth over idle periods so one quiet gap does not collapse headroom
+    _stats.alloc_rate = _stats.alloc_rate == 0
+                            ? rate
+                            : 0.7 * _stats.alloc_rate + 0.3 * rate;
+    rate_bytes = allocated_bytes;
+    rate_start = now;
+}
+
+void GcManager::update_threshold() {
+    std::chrono::duration<double> horizon = opts.horizon;
+    size_t wanted = std::max<size_t>(_stats.live_bytes,
+                                     _stats.alloc_rate * horizon.count());
+    headroom = std::clamp(wanted, opts.min_headroom, opts.max_headroom);
+    _stats.threshold = _stats.live_bytes + headroom;
+    if (rt)
+        JS_SetGCThreshold(rt, _stats.threshold);
+}
+
+bool GcManager::idle() {
+    if (!rt)
+        return false;
+    if (!state) {
+        auto now = clock::now();
+        if (now - last_measured < opts.measure_interval) {
+            _stats.skipped++;
+            update_threshold();
+            return false;
+        }
+        last_measured = now;
+    }
+    update_rate();
+    size_t heap = heap_size();
+    if (heap < _stats.live_bytes + headroom * opts.idle_ratio) {
+        _stats.skipped++;
+        // QuickJS resets the threshold after a collection of its own
+        update_threshold();
+        return false;
+    }
+
+    auto start = clock::now();
+    JS_RunGC(rt);
+    auto pause = clock::now() - start;
+
+    _stats.idle_runs++;
+    _stats.last_pause = pause;
+    _stats.total_pause += pause;
+    _stats.max_pause = std::max<std::chrono::nanoseconds>(_stats.max_pause,
+                                                          pause);
+    _stats.live_bytes = heap_size();
+    update_threshold();
+    LANY_LOG_DEBUG(
+        "idle gc: {} -> {} bytes in {}us, threshold {}", heap,
+        _stats.live_bytes,
+        std::chrono::duration_cast<std::chrono::microseconds>(pause).count(),
+        _stats.threshold);
+    return true;
+}
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include <quickjs.h>
+
+namespace lany {
+namespace js {
+
+struct GcStats {
+    uint64_t idle_runs = 0;
+    uint64_t skipped = 0;
+    std::chrono::nanoseconds total_pause{0};
+    std::chrono::nanoseconds max_pause{0};
+    std::chrono::nanoseconds last_pause{0};
+    size_t live_bytes = 0;
+    size_t threshold = 0;
+    double alloc_rate = 0; // bytes per second
+};
+
+// Keeps QuickJS garbage collection off the request path.
+//
+// While jobs run, the GC threshold is held at the live heap size plus a
+// headroom sized from the recent allocation rate, so a collection rarely
+// trips in the middle of a query. Collections are instead run by idle()
+// between batches once enough garbage has accumulated.
+//
+// Runtimes created with `malloc_functions` and the manager as opaque also
+// report every allocation, which lets Core charge allocated bytes to the
+// entry point that ran each job.
+class GcManager {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Options {
+        size_t min_headroom = 8 << 20;
+        size_t max_headroom = 256 << 20;
+        // headroom covers this much time at the measured allocation rate
+        std::chrono::milliseconds horizon{2000};
+        // run an idle collection once garbage exceeds this share of headroom
+        double idle_ratio = 0.25;
+        // without malloc_functions the heap can only be measured by walking
+        // it, which idle() then does at most once per interval
+        std::chrono::milliseconds measure_interval{100};
+    };
+
+    static const JSMallocFunctions malloc_functions;
+
+private:
+    Options opts;
+    JSRuntime *rt = nullptr;
+    JSMallocState *state = nullptr;
+    uint64_t allocated_bytes = 0;
+    size_t headroom;
+    uint64_t rate_bytes = 0;
+    clock::time_point rate_start;
+    clock::time_point last_measured;
+    GcStats _stats;
+
+    static void *js_gc_malloc(JSMallocState *s, size_t size);
+    static void js_gc_free(JSMallocState *s, void *ptr);
+    static void *js_gc_realloc(JSMallocState *s, void *ptr, size_t size);
+    static size_t js_gc_malloc_usable_size(const void *ptr);
+
+    void update_rate();
+    void update_threshold();
+
+public:
+    GcManager();
+    GcManager(const Options &opts);
+    GcManager(const GcManager &) = delete;
+    GcManager &operator=(const GcManager &) = delete;
+
+    void attach(JSRuntime *rt);
+    // Cumulative bytes allocated; stays 0 unless the runtime uses
+    // malloc_functions.
+    inline uint64_t allocated() const noexcept { return allocated_bytes; }
+    size_t heap_size() const;
+    // Called between batches; collects if enough garbage has built up.
+    // Returns true if a collection ran.
+    bool idle();
+    inline const GcStats &stats() const noexcept { return _stats; }
+};
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,125 @@
+#include "http.hpp"
+#include "engine.hpp"
+#include "error.hpp"
+#include "module.hpp"
+#include "util/http_client.hpp"
+#include "util/log.hpp"
+#include "worker.hpp"
+
+#include <quickjs.h>
+
+namespace {
+
+using namespace lany;
+
+util::http_client &client() {
+    static util::http_client c;
+    return c;
+}
+
+// res.text(): the body decoded as UTF-8
+JSValue js_response_text(JSContext *ctx, JSValueConst this_val, int argc,
+                         JSValueConst *argv) {
+    JSValue body = JS_GetPropertyStr(ctx, this_val, "body");
+    if (JS_IsException(body))
+        return body;
+    size_t size;
+    uint8_t *data = JS_GetArrayBuffer(ctx, &size, body);
+    JSValue ret = data ? JS_NewStringLen(ctx, reinterpret_cast<char *>(data),
+                                         size)
+                       : JS_EXCEPTION;
+    JS_FreeValue(ctx, body);
+    return ret;
+}
+
+JSValue make_response(JSContext *ctx, const util::http_response &res) {
+    if (!res.error.empty()) {
+        // counted against the engine like any other upstream failure
+        bool timeout = res.timed_out;
+        JSValue err = js::new_engine_error(
+            ctx,
+            timeout ? js::ErrorCategory::timeout : js::ErrorCategory::upstream,
+            timeout ? "http-timeout" : "http-failed", res.error);
+        return JS_IsException(err) ? err : JS_Throw(ctx, err);
+    }
+    JSValue headers = JS_NewObject(ctx);
+    for (auto &[name, value] : res.headers)
+        JS_DefinePropertyValueStr(
+            ctx, headers, name.c_str(),
+            JS_NewStringLen(ctx, value.data(), value.size()), JS_PROP_C_W_E);
+    JSValue obj = JS_NewObject(ctx);
+    JS_DefinePropertyValueStr(ctx, obj, "status", JS_NewInt32(ctx, res.status),
+                              JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(ctx, obj, "headers", headers, JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(
+        ctx, obj, "body",
+        JS_NewArrayBufferCopy(
+            ctx, reinterpret_cast<const uint8_t *>(res.body.data()),
+            res.body.size()),
+        JS_PROP_C_W_E);
+    JS_DefinePropertyValueStr(
+        ctx, obj, "text", JS_NewCFunction(ctx, js_response_text, "text", 0),
+        JS_PROP_C_W_E);
+    return obj;
+}
+
+JSValue js_http_get(JSContext *ctx, JSValueConst this_val, int argc,
+                    JSValueConst *argv) {
+    if (argc < 1)
+        return JS_ThrowTypeError(ctx, "get expects a url");
+    int64_t timeout = 10000;
+    if (argc > 1 && JS_IsObject(argv[1])) {
+        JSValue val = JS_GetPropertyStr(ctx, argv[1], "timeout");
+        int err = JS_IsUndefined(val) ? 0 : JS_ToInt64(ctx, &timeout, val);
+        JS_FreeValue(ctx, val);
+        if (err < 0)
+            return JS_EXCEPTION;
+    }
+    size_t len;
+    const char *url = JS_ToCStringLen(ctx, &len, argv[0]);
+    if (!url)
+        return JS_EXCEPTION;
+
+    // numbered by the search making it, for replays of recorded upstreams
+    auto search = js::active_search(JS_GetRuntime(ctx));
+    util::replay_key key;
+    key.search = search.search;
+    if (key.search >= 0)
+        key.fetch = js::next_fetch(JS_GetRuntime(ctx), key.search);
+
+    js::NativeCompletion complete;
+    JSValue promise = js::new_native_promise(ctx, complete);
+    if (!JS_IsException(promise))
+        client().get(
+            {url, len}, std::chrono::milliseconds(timeout),
+            [complete, engine = search.engine,
+             target = std::string(url, len)](util::http_response res) {
+                if (!res.error.empty())
+                    LANY_LOG(WARN, engine, "http get {} failed: {}", target,
+                             res.error);
+                complete([res = std::move(res)](JSContext *ctx) {
+                    return make_response(ctx, res);
+                });
+            },
+            key);
+    JS_FreeCString(ctx, url);
+    return promise;
+}
+
+} // namespace
+
+namespace lany {
+namespace js {
+
+void register_http_module() {
+    Module module;
+    module.add_fn("get", js_http_get, 2);
+    register_module("searxpp:http", module);
+}
+
+void set_http_upstream(const std::string &host, uint16_t port) {
+    client().redirect(host, port);
+}
+
+} // namespace js
+} // namespace lany
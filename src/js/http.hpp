@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace lany {
+namespace js {
+
+// Registers the "searxpp:http" builtin module.
+//
+//   import { get } from "searxpp:http";
+//   const res = await get(url, { timeout: 5000 });
+//   res.status; res.headers["content-type"]; JSON.parse(res.text());
+//
+// `body` is an ArrayBuffer holding the response bytes, already decoded from
+// whatever Content-Encoding the upstream chose among the ones the client
+// offers; text() reads it as UTF-8. Requests run on a shared background
+// client and settle through poll_workers, so they count as pending work of
+// the runtime. Failed requests reject with an EngineError of category
+// "timeout" (code "http-timeout") or "upstream" (code "http-failed").
+void register_http_module();
+
+// Sends all requests to host:port instead of their upstream, with the
+// upstream host as the first path segment. Used to replay recordings.
+void set_http_upstream(const std::string &host, uint16_t port);
+
+} // namespace js
+} // namespace lany
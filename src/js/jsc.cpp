@@ -3,6 +3,8 @@
 #include "jsc.hpp"
 // #include "macro.hpp"
 #include "module.hpp"
+#include "worker.hpp"
+#include "util/log.hpp"
 
 #include <cassert>
 #include <filesystem>
@@ -10,30 +12,18 @@
 
 #include <quickjs-libc.h>
 #include <quickjs.h>
-#include <spdlog/spdlog.h>
-#if defined(_WIN32) || defined(_WIN64)
-#include <spdlog/sinks/wincolor_sink.h>
-using console_sink_mt = spdlog::sinks::wincolor_stderr_sink_mt;
-#else
-#include <spdlog/sinks/stdout_color_sinks.h>
-using console_sink_mt = spdlog::sinks::stderr_color_sink_mt;
-#endif
-
-static auto jsc_cs = std::make_shared<console_sink_mt>();
-static spdlog::logger dp_logger("JS Dump Error Logger", {jsc_cs});
 
 static std::string read_file(const std::string_view &filename) {
     std::ifstream file(filename.data(), std::ios::in | std::ios::binary);
     if (!file) {
-        spdlog::error("Could not open file: {}", filename);
+        LANY_LOG_ERROR("Could not open file: {}", filename);
         return "";
     }
 
     auto ret = std::string((std::istreambuf_iterator<char>(file)),
                            std::istreambuf_iterator<char>());
-    spdlog::info("Read file: {}", filename);
-    spdlog::debug("Read file size: {}", ret.size());
-    spdlog::debug("Read file content:\n{}", ret);
+    LANY_LOG_INFO("Read file: {}", filename);
+    LANY_LOG_DEBUG("Read file size: {}", ret.size());
     return ret;
 }
 
@@ -68,7 +58,7 @@ static int js_set_import_meta(JSContext *ctx, JSValueConst func_val,
     } else {
         url = module_name;
     }
-    spdlog::debug("Set import.meta.url: {}", url);
+    LANY_LOG_DEBUG("Set import.meta.url: {}", url);
     JS_FreeCString(ctx, module_name.data());
 
     JSValue meta_obj = JS_GetImportMeta(ctx, m);
@@ -88,19 +78,23 @@ static JSModuleDef *jsc_module_loader(JSContext *ctx, const char *module_name,
 
     using namespace lany::js;
     JSModuleDef *m = nullptr;
-    EntryPoint *ep = static_cast<EntryPoint *>(opaque);
+    ModuleCache *modules = static_cast<ModuleCache *>(opaque);
 
     if (is_buildin_module(module_name)) {
         m = load_module(ctx, module_name);
         return m;
     }
 
-    std::string code = read_file(module_name);
-    if (code == "")
-        return nullptr;
-
-    JSValue func_val = JS_Eval(ctx, code.c_str(), code.size(), module_name,
-                               JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
+    JSValue func_val = JS_UNDEFINED;
+    if (modules)
+        func_val = modules->load(ctx, module_name);
+    if (JS_IsUndefined(func_val)) {
+        std::string code = read_file(module_name);
+        if (code == "")
+            return nullptr;
+        func_val = JS_Eval(ctx, code.c_str(), code.size(), module_name,
+                           JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
+    }
     if (JS_IsException(func_val))
         return nullptr;
 
@@ -136,34 +130,54 @@ namespace lany {
 namespace js {
 
 void EntryPoint::init() {
-    JS_SetModuleLoaderFunc(JS_GetRuntime(ctx), NULL, jsc_module_loader, this);
+    JS_SetModuleLoaderFunc(JS_GetRuntime(ctx), NULL, jsc_module_loader,
+                           modules);
     js_std_add_helpers(ctx, 0, nullptr);
 }
 
-EntryPoint::EntryPoint(JSRuntime *rt) {
+EntryPoint::EntryPoint(JSRuntime *rt, ModuleCache *modules)
+    : modules(modules) {
     ctx = JS_NewCustomContext(rt);
     init();
 }
 EntryPoint::EntryPoint(JSContext *ctx) : ctx(ctx) { init(); }
-EntryPoint::EntryPoint(EntryPoint &&other) {
+EntryPoint::EntryPoint(EntryPoint &&other) : modules(other.modules) {
     ctx = other.ctx;
     other.ctx = nullptr;
 }
-EntryPoint::~EntryPoint() { JS_FreeContext(ctx); }
+EntryPoint::~EntryPoint() {
+    if (ctx)
+        JS_FreeContext(ctx);
+}
 
 int EntryPoint::eval_file(const std::string_view &filename) noexcept {
-    std::string code = read_file(filename);
-    if (code == "")
-        return -1;
+    JSValue obj = JS_UNDEFINED;
+    if (modules) {
+        obj = modules->load(ctx, std::string(filename));
+        if (!JS_IsUndefined(obj) && !JS_IsException(obj)) {
+            if (JS_ResolveModule(ctx, obj) < 0) {
+                JS_FreeValue(ctx, obj);
+                obj = JS_EXCEPTION;
+            } else {
+                obj = JS_EvalFunction(ctx, obj);
+            }
+        }
+    }
 
-    int eval_flags;
-    if (JS_DetectModule(code.c_str(), code.size()))
-        eval_flags = JS_EVAL_TYPE_MODULE;
-    else
-        eval_flags = JS_EVAL_TYPE_GLOBAL;
+    if (JS_IsUndefined(obj)) {
+        std::string code = read_file(filename);
+        if (code == "")
+            return -1;
+
+        int eval_flags;
+        if (JS_DetectModule(code.c_str(), code.size()))
+            eval_flags = JS_EVAL_TYPE_MODULE;
+        else
+            eval_flags = JS_EVAL_TYPE_GLOBAL;
 
-    JSValue obj =
-        JS_Eval(ctx, code.c_str(), code.size(), filename.data(), eval_flags);
+        obj = JS_Eval(ctx, code.c_str(), code.size(), filename.data(),
+                      eval_flags);
+    }
     if (JS_IsException(obj)) {
         JS_FreeValue(ctx, obj);
         dump_error();
@@ -190,50 +204,174 @@ void EntryPoint::dump_error(JSContext *error_ctx) noexcept {
     if (!error_ctx)
         error_ctx = ctx;
     JSValue exn = JS_GetException(error_ctx);
-    std::string_view err = JS_ToCString(error_ctx, exn);
-    if (err.empty())
-        dp_logger.error("unknown exception");
-    else
-        dp_logger.error("{}", err);
-    if (JS_IsError(error_ctx, exn)) {
-        JSValue val = JS_GetPropertyStr(error_ctx, exn, "stack");
-        if (!JS_IsUndefined(val)) {
-            std::string_view stack = JS_ToCString(error_ctx, val);
-            if (!stack.empty())
-                dp_logger.error("JS stack: {}", stack);
-            JS_FreeCString(error_ctx, stack.data());
+    ErrorInfo info;
+    if (get_engine_error(error_ctx, exn, info)) {
+        // native fields, no conversion through JS
+        LANY_LOG_ERROR("{}:{}: {} [{}]", category_name(info.category),
+                       info.code, info.message, info.engine);
+    } else {
+        const char *err = JS_ToCString(error_ctx, exn);
+        if (err) {
+            LANY_LOG_ERROR("{}", err);
+            JS_FreeCString(error_ctx, err);
+        } else {
+            JS_FreeValue(error_ctx, JS_GetException(error_ctx));
+            LANY_LOG_ERROR("unknown exception");
         }
-        JS_FreeValue(error_ctx, val);
     }
-    JS_FreeCString(error_ctx, err.data());
+    // only present on Errors and sampled EngineErrors
+    std::string stack = render_stack(error_ctx, exn);
+    if (!stack.empty())
+        LANY_LOG_ERROR("JS stack: {}", stack);
     JS_FreeValue(error_ctx, exn);
 }
 
-Core::Core() { rt = JS_NewRuntime(); }
-Core::Core(JSRuntime *rt) : rt(rt) {}
-Core::Core(Core &&other) {
+Core::Core()
+    : gc(std::make_unique<GcManager>()),
+      modules(std::make_unique<ModuleCache>()) {
+    rt = JS_NewRuntime2(&GcManager::malloc_functions, gc.get());
+    gc->attach(rt);
+}
+Core::Core(JSRuntime *rt)
+    : rt(rt), gc(std::make_unique<GcManager>()),
+      modules(std::make_unique<ModuleCache>()) {
+    gc->attach(rt);
+}
+Core::Core(Core &&other)
+    : sched(std::move(other.sched)), gc(std::move(other.gc)),
+      modules(std::move(other.modules)) {
     rt = other.rt;
     other.rt = nullptr;
     ep_list.swap(other.ep_list);
 }
-Core::~Core() { JS_FreeRuntime(rt); }
+Core::~Core() {
+    if (rt) {
+        release_workers(rt);
+        release_engines(rt);
+    }
+    ep_list.clear();
+    if (rt)
+        JS_FreeRuntime(rt);
+}
+
+EntryPoint *Core::find_entry_point(JSContext *ctx) noexcept {
+    for (auto &ep : ep_list) {
+        if (ep.get_ctx() == ctx)
+            return &ep;
+    }
+    return nullptr;
+}
+
+int Core::prefetch(const std::vector<std::string> &files,
+                   size_t threads) noexcept {
+    try {
+        int ret = modules->prefetch(files, threads);
+        modules->report();
+        return ret;
+    } catch (const std::exception &e) {
+        LANY_LOG_ERROR("prefetch failed: {}", e.what());
+        return -1;
+    }
+}
 
-int Core::add_file(const std::string_view &filename) noexcept {
+int Core::add_file(const std::string_view &filename,
+                   uint32_t priority) noexcept {
     assert(rt != nullptr && "JSRuntime is nullptr");
-    auto ep = EntryPoint(rt);
-    if (!ep.eval_file(filename)) {
+    auto ep = EntryPoint(rt, modules.get());
+    if (ep.eval_file(filename) < 0) {
         return -1;
     }
+    sched.add(ep.get_ctx(), priority);
     ep_list.emplace_back(std::move(ep));
     return 0;
 }
-int Core::loop_all() noexcept {
+
+// Runs pending jobs until the queue is empty or the slice budget is spent.
+// Returns 1 if jobs are still pending, 0 if the queue was drained and -1 if
+// a job threw.
+int Core::run_slice() noexcept {
+    using clock = Scheduler::clock;
+    int ret = 1;
+    bool failed = false;
+    poll_workers(rt, 0, &sched);
+    sched.begin_slice();
+    while (sched.has_budget()) {
+        JSContext *ctx1;
+        auto start = clock::now();
+        uint64_t allocated = gc->allocated();
+        int err = JS_ExecutePendingJob(rt, &ctx1);
+        if (err == 0) {
+            ret = 0;
+            break;
+        }
+        sched.account(ctx1, start, clock::now(),
+                      gc->allocated() - allocated);
+        if (err < 0) {
+            failed = true;
+            if (auto ep = find_entry_point(ctx1))
+                ep->dump_error();
+            else if (!ep_list.empty())
+                ep_list.front().dump_error(ctx1);
+        }
+    }
+    return failed ? -1 : ret;
+}
+
+int Core::loop_all() noexcept { return loop_all({this}); }
+
+int Core::loop_all(const std::vector<Core *> &cores) noexcept {
     int ret = 0;
-    for (auto &ep : ep_list) {
-        if (!ep.loop())
-            ret = -1;
+    while (true) {
+        bool busy = false;
+        std::vector<Core *> waiting;
+        for (auto core : cores) {
+            int err = core->run_slice();
+            if (err < 0)
+                ret = -1;
+            if (err != 0)
+                busy = true;
+            else if (has_pending_workers(core->rt))
+                waiting.push_back(core);
+        }
+        if (busy)
+            continue;
+        // every queue is drained: collect before waiting for more work
+        for (auto core : cores)
+            core->gc->idle();
+        if (waiting.empty())
+            break;
+        if (waiting.size() == 1) {
+            poll_workers(waiting[0]->rt, -1, &waiting[0]->sched);
+            continue;
+        }
+        // the epoch is read first, so a reply that lands while the others
+        // are polled still wakes the wait below
+        uint32_t epoch = worker_reply_epoch();
+        int settled = 0;
+        for (auto core : waiting)
+            settled += poll_workers(core->rt, 0, &core->sched);
+        if (settled == 0)
+            wait_worker_reply(epoch);
     }
     return ret;
 }
+
+bool Core::has_pending() noexcept {
+    return JS_IsJobPending(rt) || has_pending_workers(rt);
+}
+
+std::vector<std::string> Core::engines() const { return engine_names(rt); }
+
+std::vector<ErrorCount> Core::error_counts() const {
+    return js::error_counts(rt);
+}
+
+int Core::search(const std::string &engine, const std::string &query,
+                 SearchCallback done, int64_t search) noexcept {
+    int ret = start_search(rt, engine, query, std::move(done), search);
+    if (ret == 0)
+        sched.enqueued(engine_context(rt, engine));
+    return ret;
+}
 } // namespace js
 } // namespace lany
\ No newline at end of file
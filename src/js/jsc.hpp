@@ -1,19 +1,28 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
 #include <string_view>
 #include <vector>
 
 #include <quickjs.h>
 
+#include "engine.hpp"
+#include "error.hpp"
+#include "gc.hpp"
+#include "prefetch.hpp"
+#include "scheduler.hpp"
+
 namespace lany {
 namespace js {
 class EntryPoint {
     JSContext *ctx;
+    ModuleCache *modules = nullptr;
     void init();
 
 public:
-    EntryPoint(JSRuntime *rt);
+    EntryPoint(JSRuntime *rt, ModuleCache *modules = nullptr);
     EntryPoint(JSContext *ctx);
     EntryPoint(const EntryPoint &) = delete;
     EntryPoint(EntryPoint &&other);
@@ -29,6 +38,11 @@ public:
 class Core {
     std::vector<EntryPoint> ep_list;
     JSRuntime *rt;
+    Scheduler sched;
+    std::unique_ptr<GcManager> gc;
+    std::unique_ptr<ModuleCache> modules;
+
+    EntryPoint *find_entry_point(JSContext *ctx) noexcept;
 
 public:
     Core();
@@ -37,8 +51,28 @@ public:
     Core(Core &&other);
     ~Core();
 
-    int add_file(const std::string_view &filename) noexcept;
+    inline Scheduler &get_scheduler() noexcept { return sched; }
+    inline GcManager &get_gc() noexcept { return *gc; }
+    inline ModuleCache &get_module_cache() noexcept { return *modules; }
+
+    // Compiles the import graphs of `files` ahead of add_file, in parallel.
+    int prefetch(const std::vector<std::string> &files,
+                 size_t threads = 0) noexcept;
+    int add_file(const std::string_view &filename,
+                 uint32_t priority = 1) noexcept;
+    int run_slice() noexcept;
     int loop_all() noexcept;
+    // Runs `cores` until all of them are idle, one slice of each in turn, so
+    // a long promise chain in one runtime cannot hold back the others.
+    static int loop_all(const std::vector<Core *> &cores) noexcept;
+    bool has_pending() noexcept;
+
+    std::vector<std::string> engines() const;
+    // Failed searches per engine and error category.
+    std::vector<ErrorCount> error_counts() const;
+    // `search` numbers the search for replay keys, see start_search.
+    int search(const std::string &engine, const std::string &query,
+               SearchCallback done, int64_t search = -1) noexcept;
 };
 } // namespace js
 } // namespace lany
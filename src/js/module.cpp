@@ -2,19 +2,78 @@
 #include "module.hpp"
 #include "macro.hpp"
 #include "quickjs.h"
+#include "util/log.hpp"
 
 #include <map>
-
-#include <spdlog/spdlog.h>
 #include <string_view>
 
 static std::map<std::string, lany::js::Module> module_map;
 
+// Allocated once for all runtimes; getters may run on several threads.
+static JSClassID object_ref_class_id() {
+    static const JSClassID id = [] {
+        JSClassID id = 0;
+        JS_NewClassID(&id);
+        return id;
+    }();
+    return id;
+}
+
+// Keeps a nested Object alive for as long as an unmaterialized lazy property
+// may still refer to it.
+static void object_ref_finalizer(JSRuntime *rt, JSValue val) {
+    delete static_cast<std::shared_ptr<lany::js::Object> *>(
+        JS_GetOpaque(val, object_ref_class_id()));
+}
+
+static JSValue new_object_ref(JSContext *ctx,
+                              const std::shared_ptr<lany::js::Object> &obj) {
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    JSClassID class_id = object_ref_class_id();
+    if (!JS_IsRegisteredClass(rt, class_id)) {
+        auto class_def = JSClassDef{"ObjectRef", object_ref_finalizer, nullptr,
+                                    nullptr, nullptr};
+        if (JS_NewClass(rt, class_id, &class_def) < 0)
+            return JS_EXCEPTION;
+    }
+    JSValue ref = JS_NewObjectClass(ctx, class_id);
+    if (JS_IsException(ref))
+        return ref;
+    JS_SetOpaque(ref, new std::shared_ptr<lany::js::Object>(obj));
+    return ref;
+}
+
+// Getter of a lazy nested object: materializes it on first access and
+// replaces itself on the holder (func_data[2]) with a data property holding
+// the result, so every context builds each nested object at most once and
+// only if it is used. The holder, not `this`, gets the property: reading it
+// through an object inheriting from the holder must not shadow it there.
+static JSValue lazy_object_getter(JSContext *ctx, JSValueConst this_val,
+                                  int argc, JSValueConst *argv, int magic,
+                                  JSValue *func_data) {
+    auto ref = static_cast<std::shared_ptr<lany::js::Object> *>(
+        JS_GetOpaque2(ctx, func_data[0], object_ref_class_id()));
+    if (!ref)
+        return JS_EXCEPTION;
+    JSValue val = (*ref)->to_js_value(ctx);
+    if (JS_IsException(val))
+        return val;
+    JSAtom atom = JS_ValueToAtom(ctx, func_data[1]);
+    int err = JS_DefinePropertyValue(ctx, func_data[2], atom,
+                                     JS_DupValue(ctx, val), magic);
+    JS_FreeAtom(ctx, atom);
+    if (err < 0) {
+        JS_FreeValue(ctx, val);
+        return JS_EXCEPTION;
+    }
+    return val;
+}
+
 static int module_init_helper(JSContext *ctx, JSModuleDef *m) {
     using namespace lany::js;
     Module *_m = static_cast<Module *>(JS_GetContextOpaque(ctx));
     if (!_m) {
-        spdlog::error("_m is null");
+        LANY_LOG_ERROR("_m is null");
         return -1;
     }
     _m->set_export(ctx, m);
@@ -127,20 +186,48 @@ JSValue Object::to_js_value(JSContext *ctx) {
         JS_SetPropertyFunctionList(ctx, ret_obj, entries.data(),
                                    entries.size());
     for (const auto &[name, obj, dcopy, pflags] : objects) {
-        JS_DefinePropertyValueStr(ctx, ret_obj, name.data(),
-                                  obj->to_js_value(ctx), pflags);
+        // Classes are built eagerly: native code may instantiate them
+        // before script ever touches the property holding the prototype.
+        if (dynamic_cast<Class *>(obj.get())) {
+            JS_DefinePropertyValueStr(ctx, ret_obj, name.data(),
+                                      obj->to_js_value(ctx), pflags);
+            continue;
+        }
+        JSValue data[3] = {new_object_ref(ctx, obj),
+                           JS_NewStringLen(ctx, name.data(), name.size()),
+                           ret_obj};
+        JSAtom atom = JS_NewAtom(ctx, name.data());
+        JSValue getter =
+            JS_NewCFunctionData(ctx, lazy_object_getter, 0, pflags, 3, data);
+        JS_DefinePropertyGetSet(ctx, ret_obj, atom, getter, JS_UNDEFINED,
+                                (pflags & JS_PROP_ENUMERABLE) |
+                                    JS_PROP_CONFIGURABLE);
+        JS_FreeAtom(ctx, atom);
+        JS_FreeValue(ctx, data[0]);
+        JS_FreeValue(ctx, data[1]);
     }
     return ret_obj;
 }
 
-Class::Class() { spdlog::debug("create class"); }
+// Class ids are allocated here rather than on first use: classes are built
+// during startup, while to_js_value may run on several worker threads.
+Class::Class() {
+    JS_NewClassID(&class_id);
+    LANY_LOG_DEBUG("create class");
+}
+Class::Class(const std::string_view &name) : class_name(name) {
+    JS_NewClassID(&class_id);
+    LANY_LOG_DEBUG("create class: {}", name);
+}
 Class::Class(const Class &other) : Object(other) {
+    JS_NewClassID(&class_id);
     ctor = other.ctor;
     finalizer = other.finalizer;
     gc_marker = other.gc_marker;
     class_name = other.class_name;
 }
 Class::Class(Class &&other) : Object(std::move(other)) {
+    class_id = other.class_id;
     class_name = std::move(other.class_name);
     ctor = other.ctor;
     finalizer = other.finalizer;
@@ -191,17 +278,17 @@ void Class::add_getset(const std::string_view &name, JSClassGetter *getter,
 JSClassID Class::get_class_id() const { return class_id; }
 
 JSValue Class::to_js_value(JSContext *ctx) {
-    if (class_id == 0) {
-        JS_NewClassID(&class_id);
+    if (!JS_IsRegisteredClass(JS_GetRuntime(ctx), class_id)) {
         auto class_def =
             JSClassDef{class_name.c_str(), finalizer, gc_marker, ctor, nullptr};
         if (JS_NewClass(JS_GetRuntime(ctx), class_id, &class_def) < 0) {
-            spdlog::error("failed to register class");
+            LANY_LOG_ERROR("failed to register class");
             return JS_EXCEPTION;
         }
     }
     JSValue ret_obj = Object::to_js_value(ctx);
-    JS_SetClassProto(ctx, get_class_id(), ret_obj);
+    // the context keeps its own reference to the prototype
+    JS_SetClassProto(ctx, get_class_id(), JS_DupValue(ctx, ret_obj));
     if (ctor != nullptr)
         JS_SetConstructorBit(ctx, ret_obj, true);
     return ret_obj;
@@ -228,25 +315,25 @@ Module &Module::operator=(Module &&other) {
 
 void Module::set_export(JSContext *ctx, JSModuleDef *m) {
     for (const auto &entry : entries) {
-        spdlog::debug("export: {}", entry.name);
+        LANY_LOG_DEBUG("export: {}", entry.name);
     }
     if (!entries.empty()) {
         JS_SetModuleExportList(ctx, m, entries.data(), entries.size());
     }
     for (const auto &[name, obj, dcopy, pflags] : objects) {
-        spdlog::debug("export: {}", name);
+        LANY_LOG_DEBUG("export: {}", name);
         JS_SetModuleExport(ctx, m, name.data(), obj->to_js_value(ctx));
     }
-    spdlog::debug("export count: {}", entries.size() + objects.size());
+    LANY_LOG_DEBUG("export count: {}", entries.size() + objects.size());
 }
 
 JSModuleDef *Module::init_module(JSContext *ctx,
                                  const std::string_view &module_name) {
-    spdlog::debug("init c module name: \"{}\"", module_name);
+    LANY_LOG_DEBUG("init c module name: \"{}\"", module_name);
     JS_SetContextOpaque(ctx, this);
     JSModuleDef *m = JS_NewCModule(ctx, module_name.data(), module_init_helper);
     if (m == nullptr) {
-        spdlog::error("failed to create module");
+        LANY_LOG_ERROR("failed to create module");
         return nullptr;
     }
     // add export
@@ -271,15 +358,15 @@ JSModuleDef *load_module(JSContext *ctx, const std::string &name) {
 }
 
 void register_module(const std::string &name, const Module &module) {
-    spdlog::info("register c module: {}", util::quote(name));
+    LANY_LOG_INFO("register c module: {}", util::quote(name));
     if (is_buildin_module(name)) {
-        spdlog::warn("buildin module {} already registered", name);
+        LANY_LOG_WARN("buildin module {} already registered", name);
         return;
     }
     module_map.emplace(name, module);
 }
 void unregister_module(const std::string &name) {
-    spdlog::info("unregister c module: {}", util::quote(name));
+    LANY_LOG_INFO("unregister c module: {}", util::quote(name));
     module_map.erase(name);
 }
 } // namespace js
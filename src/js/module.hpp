@@ -9,7 +9,6 @@
 #include <vector>
 
 #include <quickjs.h>
-#include <spdlog/spdlog.h>
 
 #include "macro.hpp"
 
@@ -72,6 +71,9 @@ public:
                  uint8_t prop_flags = JS_PROP_C_W_E);
     void add_alias(const std::string_view &name, const std::string_view &from,
                    int base = -1);
+    // Nested Objects become accessors that build them on first access.
+    // Nested Classes are built right away, as are the top-level exports of a
+    // Module, which QuickJS binds when the module is instantiated.
     virtual JSValue to_js_value(JSContext *ctx);
 };
 
@@ -79,15 +81,16 @@ class Class : public Object {
     JSClassID class_id = 0;
 
 protected:
-    JSClassCall *ctor;
-    JSClassFinalizer *finalizer;
-    JSClassGCMark *gc_marker;
+    JSClassCall *ctor = nullptr;
+    JSClassFinalizer *finalizer = nullptr;
+    JSClassGCMark *gc_marker = nullptr;
 
     std::string class_name;
     virtual std::shared_ptr<Object> dup() override;
 
 public:
     Class();
+    Class(const std::string_view &name);
     Class(const Class &);
     Class(Class &&other);
     Class &operator=(const Class &);
@@ -0,0 +1,341 @@
+#include "prefetch.hpp"
+#include "module.hpp"
+#include "util/log.hpp"
+#include "util/thread_pool.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+bool is_ident(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == '$' ||
+           static_cast<unsigned char>(c) >= 0x80;
+}
+
+class ImportScanner {
+    std::string_view src;
+    size_t pos = 0;
+    std::vector<std::string> &out;
+
+    char peek() const { return pos < src.size() ? src[pos] : '\0'; }
+
+    bool skip_comment() {
+        if (pos + 1 >= src.size() || src[pos] != '/')
+            return false;
+        if (src[pos + 1] == '/') {
+            size_t end = src.find('\n', pos);
+            pos = end == std::string_view::npos ? src.size() : end;
+            return true;
+        }
+        if (src[pos + 1] == '*') {
+            size_t end = src.find("*/", pos + 2);
+            pos = end == std::string_view::npos ? src.size() : end + 2;
+            return true;
+        }
+        return false;
+    }
+
+    void skip_space() {
+        while (pos < src.size()) {
+            char c = src[pos];
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+                pos++;
+            else if (!skip_comment())
+                break;
+        }
+    }
+
+    // Reads the quoted literal at `pos`; escapes are kept verbatim, which
+    // is enough for module specifiers.
+    bool read_string(std::string *str) {
+        char quote = peek();
+        if (quote != '"' && quote != '\'' && quote != '`')
+            return false;
+        size_t start = ++pos;
+        while (pos < src.size() && src[pos] != quote) {
+            if (src[pos] == '\\')
+                pos++;
+            pos++;
+        }
+        if (str)
+            str->assign(src.substr(start, pos - start));
+        pos = std::min(pos + 1, src.size());
+        return true;
+    }
+
+    std::string_view read_ident() {
+        size_t start = pos;
+        while (pos < src.size() && is_ident(src[pos]))
+            pos++;
+        return src.substr(start, pos - start);
+    }
+
+    // After `import` or `export`: walks the binding list up to `from`.
+    void clause(bool is_import) {
+        std::string spec;
+        skip_space();
+        if (is_import && peek() == '(') {
+            pos++;
+            skip_space();
+            if (peek() != '`' && read_string(&spec)) {
+                skip_space();
+                if (peek() == ')')
+                    out.push_back(std::move(spec));
+            }
+            return;
+        }
+        if (is_import && peek() != '`' && read_string(&spec)) {
+            out.push_back(std::move(spec));
+            return;
+        }
+        while (pos < src.size()) {
+            skip_space();
+            char c = peek();
+            if (c == '{' || c == '}' || c == ',' || c == '*') {
+                pos++;
+            } else if (is_ident(c)) {
+                if (read_ident() != "from")
+                    continue;
+                skip_space();
+                if (peek() != '`' && read_string(&spec))
+                    out.push_back(std::move(spec));
+                return;
+            } else {
+                return;
+            }
+        }
+    }
+
+public:
+    ImportScanner(std::string_view src, std::vector<std::string> &out)
+        : src(src), out(out) {}
+
+    void run() {
+        while (pos < src.size()) {
+            char c = src[pos];
+            if (skip_comment() || read_string(nullptr))
+                continue;
+            if (!is_ident(c)) {
+                pos++;
+                continue;
+            }
+            bool member = pos > 0 && src[pos - 1] == '.';
+            std::string_view word = read_ident();
+            if (!member && (word == "import" || word == "export"))
+                clause(word == "import");
+        }
+    }
+};
+
+bool read_source(const std::string &name, std::string &code,
+                 lany::js::ModuleTiming &timing) {
+    auto start = clock::now();
+    std::ifstream file(name, std::ios::in | std::ios::binary);
+    if (!file)
+        return false;
+    code.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+    timing.read = duration_cast<microseconds>(clock::now() - start);
+    timing.source_size = code.size();
+    // plain scripts cannot import and are evaluated from source
+    return JS_DetectModule(code.c_str(), code.size());
+}
+
+JSModuleDef *placeholder_loader(JSContext *ctx, const char *module_name,
+                                void *opaque) {
+    // every import is compiled on its own; resolving only needs a name
+    return JS_NewCModule(ctx, module_name,
+                         [](JSContext *, JSModuleDef *) { return 0; });
+}
+
+struct CompileRuntime {
+    JSRuntime *rt;
+
+    CompileRuntime() : rt(JS_NewRuntime()) {
+        JS_SetModuleLoaderFunc(rt, nullptr, placeholder_loader, nullptr);
+    }
+    ~CompileRuntime() { JS_FreeRuntime(rt); }
+};
+
+void compile(const std::string &name, const std::string &code,
+             std::string &bytecode, lany::js::ModuleTiming &timing) {
+    thread_local CompileRuntime compiler;
+    auto start = clock::now();
+    JSContext *ctx = JS_NewContext(compiler.rt);
+    JSValue func_val =
+        JS_Eval(ctx, code.c_str(), code.size(), name.c_str(),
+                JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
+    if (JS_IsException(func_val)) {
+        // left to the loader, which reports the error in its context
+        JS_FreeValue(ctx, JS_GetException(ctx));
+    } else {
+        size_t size;
+        uint8_t *buf =
+            JS_WriteObject(ctx, &size, func_val, JS_WRITE_OBJ_BYTECODE);
+        if (buf) {
+            bytecode.assign(reinterpret_cast<char *>(buf), size);
+            timing.bytecode_size = size;
+            timing.ok = true;
+            js_free(ctx, buf);
+        }
+        JS_FreeValue(ctx, func_val);
+    }
+    JS_FreeContext(ctx);
+    timing.compile = duration_cast<microseconds>(clock::now() - start);
+}
+
+} // namespace
+
+namespace lany {
+namespace js {
+
+std::vector<std::string> scan_imports(std::string_view code) {
+    std::vector<std::string> imports;
+    ImportScanner(code, imports).run();
+    return imports;
+}
+
+std::string normalize_module_name(std::string_view base,
+                                  std::string_view name) {
+    if (name.empty() || name[0] != '.')
+        return std::string(name);
+
+    size_t slash = base.rfind('/');
+    std::string filename(
+        base.substr(0, slash == std::string_view::npos ? 0 : slash));
+    while (true) {
+        if (name.starts_with("./")) {
+            name.remove_prefix(2);
+        } else if (name.starts_with("../")) {
+            if (filename.empty())
+                break;
+            size_t p = filename.rfind('/');
+            size_t start = p == std::string::npos ? 0 : p + 1;
+            std::string_view last(filename.data() + start,
+                                  filename.size() - start);
+            if (last == "." || last == "..")
+                break;
+            filename.resize(p == std::string::npos ? 0 : p);
+            name.remove_prefix(3);
+        } else {
+            break;
+        }
+    }
+    if (!filename.empty())
+        filename += '/';
+    filename += name;
+    return filename;
+}
+
+int ModuleCache::prefetch(const std::vector<std::string> &roots,
+                          size_t threads) {
+    auto start = clock::now();
+    std::condition_variable done;
+    size_t outstanding = 0;
+    std::function<void(const std::string &)> schedule;
+    {
+        util::thread_pool pool(threads);
+        // called with mtx held
+        schedule = [&](const std::string &name) {
+            if (is_buildin_module(name) || !entries.try_emplace(name).second)
+                return;
+            outstanding++;
+            pool.submit([&, name] {
+                ModuleTiming timing;
+                std::string code, bytecode;
+                timing.name = name;
+                if (read_source(name, code, timing)) {
+                    auto imports = scan_imports(code);
+                    {
+                        // queue the imports before compiling this module
+                        std::lock_guard lock(mtx);
+                        for (auto &spec : imports)
+                            schedule(normalize_module_name(name, spec));
+                    }
+                    compile(name, code, bytecode, timing);
+                }
+
+                std::lock_guard lock(mtx);
+                auto &entry = entries[name];
+                entry.timing = std::move(timing);
+                entry.bytecode = std::move(bytecode);
+                if (--outstanding == 0)
+                    done.notify_all();
+            });
+        };
+
+        std::unique_lock lock(mtx);
+        for (auto &root : roots)
+            schedule(root);
+        done.wait(lock, [&] { return outstanding == 0; });
+    }
+
+    std::lock_guard lock(mtx);
+    wall = duration_cast<microseconds>(clock::now() - start);
+    int cached = 0;
+    for (auto &[name, entry] : entries)
+        if (entry.timing.ok)
+            cached++;
+    return cached;
+}
+
+JSValue ModuleCache::load(JSContext *ctx, const std::string &name) noexcept {
+    Entry *entry;
+    {
+        std::lock_guard lock(mtx);
+        auto it = entries.find(name);
+        if (it == entries.end() || !it->second.timing.ok)
+            return JS_UNDEFINED;
+        entry = &it->second;
+    }
+
+    // bytecode is immutable once compiled, so it is read without the lock
+    auto start = clock::now();
+    JSValue val = JS_ReadObject(
+        ctx, reinterpret_cast<const uint8_t *>(entry->bytecode.data()),
+        entry->bytecode.size(), JS_READ_OBJ_BYTECODE);
+    auto elapsed = duration_cast<microseconds>(clock::now() - start);
+
+    std::lock_guard lock(mtx);
+    entry->timing.load += elapsed;
+    entry->timing.loads++;
+    return val;
+}
+
+std::vector<ModuleTiming> ModuleCache::timings() const {
+    std::lock_guard lock(mtx);
+    std::vector<ModuleTiming> ret;
+    ret.reserve(entries.size());
+    for (auto &[name, entry] : entries)
+        ret.push_back(entry.timing);
+    std::sort(ret.begin(), ret.end(),
+              [](auto &a, auto &b) { return a.name < b.name; });
+    return ret;
+}
+
+void ModuleCache::report() const {
+    auto list = timings();
+    LANY_LOG_INFO("prefetched {} modules in {}us", list.size(), wall.count());
+    for (auto &t : list) {
+        if (!t.ok) {
+            LANY_LOG_WARN("  {}: not precompiled", t.name);
+            continue;
+        }
+        LANY_LOG_INFO("  {}: read {}us, compile {}us, load {}us x{}, "
+                      "{} -> {} bytes",
+                      t.name, t.read.count(), t.compile.count(),
+                      t.load.count(), t.loads, t.source_size,
+                      t.bytecode_size);
+    }
+}
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <quickjs.h>
+
+namespace lany {
+namespace js {
+
+struct ModuleTiming {
+    std::string name;
+    std::chrono::microseconds read{0};
+    std::chrono::microseconds compile{0};
+    std::chrono::microseconds load{0};
+    size_t source_size = 0;
+    size_t bytecode_size = 0;
+    uint32_t loads = 0;
+    bool ok = false;
+};
+
+// Static import specifiers of `code`, in source order. The scan is lexical
+// and may miss or over-report in unusual code; that only costs a cache
+// miss, never a wrong module.
+std::vector<std::string> scan_imports(std::string_view code);
+// Resolves `name` against the importing module `base` the same way the
+// QuickJS default normalizer does.
+std::string normalize_module_name(std::string_view base, std::string_view name);
+
+// Bytecode of a module graph compiled ahead of time. prefetch() reads and
+// compiles every file module reachable from the roots on a thread pool,
+// each thread with its own runtime; load() then only deserializes.
+class ModuleCache {
+    struct Entry {
+        ModuleTiming timing;
+        std::string bytecode;
+    };
+    mutable std::mutex mtx;
+    std::unordered_map<std::string, Entry> entries;
+    std::chrono::microseconds wall{0};
+
+public:
+    ModuleCache() = default;
+    ModuleCache(const ModuleCache &) = delete;
+
+    // Blocks until the whole graph is compiled. Returns the number of
+    // modules cached.
+    int prefetch(const std::vector<std::string> &roots, size_t threads = 0);
+    // Deserializes the cached module `name`; JS_UNDEFINED if it is not
+    // cached, JS_EXCEPTION if reading failed.
+    JSValue load(JSContext *ctx, const std::string &name) noexcept;
+
+    std::vector<ModuleTiming> timings() const;
+    void report() const;
+};
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,418 @@
+#include "result_batch.hpp"
+#include "module.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include <quickjs.h>
+
+namespace {
+
+using namespace lany;
+
+constexpr uint32_t string_fields = 3;
+
+// Growable storage for one column. Once a view has been handed to JS the
+// block is shared and growing it copies into a fresh block instead of
+// reallocating memory a TypedArray still points to.
+template <typename T> class Column {
+    std::shared_ptr<std::vector<T>> block = std::make_shared<std::vector<T>>();
+
+    static void free_block(JSRuntime *, void *opaque, void *) {
+        delete static_cast<std::shared_ptr<std::vector<T>> *>(opaque);
+    }
+
+public:
+    size_t size() const { return block->size(); }
+    T *data() { return block->data(); }
+    T &operator[](size_t i) { return (*block)[i]; }
+
+    void push_back(const T *src, size_t n) {
+        auto &vec = *block;
+        if (block.use_count() > 1 && vec.size() + n > vec.capacity()) {
+            auto fresh = std::make_shared<std::vector<T>>();
+            fresh->reserve(std::max(vec.capacity() * 2, vec.size() + n));
+            fresh->assign(vec.begin(), vec.end());
+            block = std::move(fresh);
+        }
+        block->insert(block->end(), src, src + n);
+    }
+    void push_back(const T &val) { push_back(&val, 1); }
+    void clear() { block = std::make_shared<std::vector<T>>(); }
+
+    JSValue to_array_buffer(JSContext *ctx) {
+        auto ref = new std::shared_ptr<std::vector<T>>(block);
+        JSValue ab = JS_NewArrayBuffer(
+            ctx, reinterpret_cast<uint8_t *>(block->data()),
+            block->size() * sizeof(T), free_block, ref, false);
+        if (JS_IsException(ab))
+            delete ref;
+        return ab;
+    }
+};
+
+enum View { view_scores, view_engines, view_positions, view_strings,
+            view_offsets, view_count };
+
+struct ResultBatch {
+    Column<double> scores;
+    Column<uint32_t> engines;
+    Column<uint32_t> positions;
+    Column<uint8_t> strings;
+    Column<uint32_t> offsets;
+    JSValue views[view_count];
+
+    ResultBatch() {
+        std::fill(std::begin(views), std::end(views), JS_UNDEFINED);
+        offsets.push_back(0);
+    }
+
+    uint32_t size() const { return scores.size(); }
+
+    void invalidate(JSRuntime *rt) {
+        for (auto &view : views) {
+            JS_FreeValueRT(rt, view);
+            view = JS_UNDEFINED;
+        }
+    }
+};
+
+auto batch_class = std::make_shared<js::Class>("ResultBatch");
+
+ResultBatch *get_batch(JSContext *ctx, JSValueConst val) {
+    return static_cast<ResultBatch *>(
+        JS_GetOpaque2(ctx, val, batch_class->get_class_id()));
+}
+
+void js_batch_finalizer(JSRuntime *rt, JSValue val) {
+    auto batch = static_cast<ResultBatch *>(
+        JS_GetOpaque(val, batch_class->get_class_id()));
+    if (!batch)
+        return;
+    batch->invalidate(rt);
+    delete batch;
+}
+
+void js_batch_gc_mark(JSRuntime *rt, JSValueConst val,
+                      JS_MarkFunc *mark_func) {
+    auto batch = static_cast<ResultBatch *>(
+        JS_GetOpaque(val, batch_class->get_class_id()));
+    if (!batch)
+        return;
+    for (auto &view : batch->views)
+        JS_MarkValue(rt, view, mark_func);
+}
+
+JSValue new_typed_array(JSContext *ctx, const char *ctor_name, JSValue ab) {
+    if (JS_IsException(ab))
+        return ab;
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue ctor = JS_GetPropertyStr(ctx, global, ctor_name);
+    JS_FreeValue(ctx, global);
+    JSValue ret = JS_CallConstructor(ctx, ctor, 1, &ab);
+    JS_FreeValue(ctx, ctor);
+    JS_FreeValue(ctx, ab);
+    return ret;
+}
+
+template <View view> JSValue js_batch_get_view(JSContext *ctx,
+                                                JSValueConst this_val) {
+    auto batch = get_batch(ctx, this_val);
+    if (!batch)
+        return JS_EXCEPTION;
+    JSValue &cached = batch->views[view];
+    if (JS_IsUndefined(cached)) {
+        if constexpr (view == view_scores)
+            cached = new_typed_array(ctx, "Float64Array",
+                                     batch->scores.to_array_buffer(ctx));
+        else if constexpr (view == view_engines)
+            cached = new_typed_array(ctx, "Uint32Array",
+                                     batch->engines.to_array_buffer(ctx));
+        else if constexpr (view == view_positions)
+            cached = new_typed_array(ctx, "Uint32Array",
+                                     batch->positions.to_array_buffer(ctx));
+        else if constexpr (view == view_strings)
+            cached = new_typed_array(ctx, "Uint8Array",
+                                     batch->strings.to_array_buffer(ctx));
+        else
+            cached = new_typed_array(ctx, "Uint32Array",
+                                     batch->offsets.to_array_buffer(ctx));
+        if (JS_IsException(cached)) {
+            cached = JS_UNDEFINED;
+            return JS_EXCEPTION;
+        }
+    }
+    return JS_DupValue(ctx, cached);
+}
+
+JSValue string_field(JSContext *ctx, ResultBatch &batch, uint32_t index,
+                     uint32_t field) {
+    uint32_t slot = index * string_fields + field;
+    uint32_t begin = batch.offsets[slot], end = batch.offsets[slot + 1];
+    return JS_NewStringLen(
+        ctx, reinterpret_cast<const char *>(batch.strings.data() + begin),
+        end - begin);
+}
+
+// Result indices ordered by descending score, ties by position.
+std::vector<uint32_t> ranked(ResultBatch &batch) {
+    std::vector<uint32_t> idx(batch.size());
+    std::iota(idx.begin(), idx.end(), 0);
+    std::stable_sort(idx.begin(), idx.end(), [&](uint32_t a, uint32_t b) {
+        if (batch.scores[a] != batch.scores[b])
+            return batch.scores[a] > batch.scores[b];
+        return batch.positions[a] < batch.positions[b];
+    });
+    return idx;
+}
+
+JSValue js_batch_get_length(JSContext *ctx, JSValueConst this_val) {
+    auto batch = get_batch(ctx, this_val);
+    if (!batch)
+        return JS_EXCEPTION;
+    return JS_NewUint32(ctx, batch->size());
+}
+
+JSValue js_create_batch(JSContext *ctx, JSValueConst this_val, int argc,
+                        JSValueConst *argv) {
+    JSValue obj = JS_NewObjectClass(ctx, batch_class->get_class_id());
+    if (JS_IsException(obj))
+        return obj;
+    JS_SetOpaque(obj, new ResultBatch);
+    return obj;
+}
+
+// push(score, engine, position, url, title, content)
+JSValue js_batch_push(JSContext *ctx, JSValueConst this_val, int argc,
+                      JSValueConst *argv) {
+    auto batch = get_batch(ctx, this_val);
+    if (!batch)
+        return JS_EXCEPTION;
+    if (argc < 3)
+        return JS_ThrowTypeError(ctx, "push expects score, engine, position");
+
+    double score;
+    uint32_t engine, position;
+    if (JS_ToFloat64(ctx, &score, argv[0]) < 0 ||
+        JS_ToUint32(ctx, &engine, argv[1]) < 0 ||
+        JS_ToUint32(ctx, &position, argv[2]) < 0)
+        return JS_EXCEPTION;
+    // ranking needs a total order, which NaN would break
+    if (!std::isfinite(score))
+        return JS_ThrowTypeError(ctx, "score must be a finite number");
+
+    const char *strs[string_fields] = {};
+    size_t lens[string_fields] = {};
+    for (uint32_t i = 0; i < string_fields; i++) {
+        if (3 + i >= static_cast<uint32_t>(argc) ||
+            JS_IsUndefined(argv[3 + i]) || JS_IsNull(argv[3 + i]))
+            continue;
+        strs[i] = JS_ToCStringLen(ctx, &lens[i], argv[3 + i]);
+        if (!strs[i]) {
+            for (uint32_t j = 0; j < i; j++)
+                JS_FreeCString(ctx, strs[j]);
+            return JS_EXCEPTION;
+        }
+    }
+
+    batch->invalidate(JS_GetRuntime(ctx));
+    uint32_t index = batch->size();
+    batch->scores.push_back(score);
+    batch->engines.push_back(engine);
+    batch->positions.push_back(position);
+    uint32_t offset = batch->offsets[batch->offsets.size() - 1];
+    for (uint32_t i = 0; i < string_fields; i++) {
+        if (strs[i]) {
+            batch->strings.push_back(reinterpret_cast<const uint8_t *>(strs[i]),
+                                     lens[i]);
+            JS_FreeCString(ctx, strs[i]);
+        }
+        offset += lens[i];
+        batch->offsets.push_back(offset);
+    }
+    return JS_NewUint32(ctx, index);
+}
+
+template <uint32_t field>
+JSValue js_batch_get_string(JSContext *ctx, JSValueConst this_val, int argc,
+                            JSValueConst *argv) {
+    auto batch = get_batch(ctx, this_val);
+    if (!batch)
+        return JS_EXCEPTION;
+    uint32_t index;
+    if (JS_ToUint32(ctx, &index, argc > 0 ? argv[0] : JS_UNDEFINED) < 0)
+        return JS_EXCEPTION;
+    if (index >= batch->size())
+        return JS_ThrowRangeError(ctx, "result index out of range");
+    return string_field(ctx, *batch, index, field);
+}
+
+JSValue js_batch_order(JSContext *ctx, JSValueConst this_val, int argc,
+                       JSValueConst *argv) {
+    auto batch = get_batch(ctx, this_val);
+    if (!batch)
+        return JS_EXCEPTION;
+    Column<uint32_t> order;
+    auto idx = ranked(*batch);
+    order.push_back(idx.data(), idx.size());
+    return new_typed_array(ctx, "Uint32Array", order.to_array_buffer(ctx));
+}
+
+JSValue js_batch_clear(JSContext *ctx, JSValueConst this_val, int argc,
+                       JSValueConst *argv) {
+    auto batch = get_batch(ctx, this_val);
+    if (!batch)
+        return JS_EXCEPTION;
+    batch->invalidate(JS_GetRuntime(ctx));
+    batch->scores.clear();
+    batch->engines.clear();
+    batch->positions.clear();
+    batch->strings.clear();
+    batch->offsets.clear();
+    batch->offsets.push_back(0);
+    return JS_UNDEFINED;
+}
+
+} // namespace
+
+namespace lany {
+namespace js {
+
+int write_ranked_batch(JSContext *ctx, JSValueConst val,
+                       std::string &payload) {
+    auto batch = static_cast<ResultBatch *>(
+        JS_GetOpaque(val, batch_class->get_class_id()));
+    if (!batch)
+        return 0;
+
+    // the columns again, permuted into ranked order
+    ResultBatch out;
+    for (uint32_t i : ranked(*batch)) {
+        out.scores.push_back(batch->scores[i]);
+        out.engines.push_back(batch->engines[i]);
+        out.positions.push_back(batch->positions[i]);
+        uint32_t slot = i * string_fields;
+        uint32_t begin = batch->offsets[slot];
+        uint32_t end = batch->offsets[slot + string_fields];
+        uint32_t base = out.offsets[out.offsets.size() - 1];
+        out.strings.push_back(batch->strings.data() + begin, end - begin);
+        for (uint32_t field = 1; field <= string_fields; field++)
+            out.offsets.push_back(base + batch->offsets[slot + field] - begin);
+    }
+
+    JSValue obj = JS_NewObject(ctx);
+    if (JS_IsException(obj))
+        return -1;
+    const std::pair<const char *, JSValue> columns[] = {
+        {"scores",
+         new_typed_array(ctx, "Float64Array", out.scores.to_array_buffer(ctx))},
+        {"engines",
+         new_typed_array(ctx, "Uint32Array", out.engines.to_array_buffer(ctx))},
+        {"positions", new_typed_array(ctx, "Uint32Array",
+                                      out.positions.to_array_buffer(ctx))},
+        {"strings",
+         new_typed_array(ctx, "Uint8Array", out.strings.to_array_buffer(ctx))},
+        {"offsets",
+         new_typed_array(ctx, "Uint32Array", out.offsets.to_array_buffer(ctx))},
+    };
+    bool ok = std::none_of(std::begin(columns), std::end(columns),
+                           [](auto &c) { return JS_IsException(c.second); });
+    for (auto &[name, column] : columns) {
+        if (!ok)
+            JS_FreeValue(ctx, column);
+        else if (JS_DefinePropertyValueStr(ctx, obj, name, column,
+                                           JS_PROP_C_W_E) < 0)
+            ok = false;
+    }
+    size_t size;
+    uint8_t *buf = ok ? JS_WriteObject(ctx, &size, obj, 0) : nullptr;
+    JS_FreeValue(ctx, obj);
+    if (!buf)
+        return -1;
+    payload.assign(reinterpret_cast<char *>(buf), size);
+    js_free(ctx, buf);
+    return 1;
+}
+
+bool read_ranked_batch(JSContext *ctx, JSValueConst val,
+                       RankedColumns &out) {
+    if (!JS_IsObject(val) || JS_IsArray(ctx, val) != 0)
+        return false;
+    auto column = [&](const char *name, size_t elem, size_t &count) {
+        JSValue arr = JS_GetPropertyStr(ctx, val, name);
+        size_t offset, len, bytes_per_element;
+        JSValue ab = JS_GetTypedArrayBuffer(ctx, arr, &offset, &len,
+                                            &bytes_per_element);
+        JS_FreeValue(ctx, arr);
+        if (JS_IsException(ab)) {
+            JS_FreeValue(ctx, JS_GetException(ctx));
+            return static_cast<const uint8_t *>(nullptr);
+        }
+        size_t size;
+        const uint8_t *data = JS_GetArrayBuffer(ctx, &size, ab);
+        // the payload value keeps the buffer alive
+        JS_FreeValue(ctx, ab);
+        if (!data || bytes_per_element != elem) {
+            JS_FreeValue(ctx, JS_GetException(ctx));
+            return static_cast<const uint8_t *>(nullptr);
+        }
+        count = len / elem;
+        return data + offset;
+    };
+    size_t n_scores, n_engines, n_positions, n_strings, n_offsets;
+    out.scores = reinterpret_cast<const double *>(
+        column("scores", sizeof(double), n_scores));
+    out.engines = reinterpret_cast<const uint32_t *>(
+        column("engines", sizeof(uint32_t), n_engines));
+    out.positions = reinterpret_cast<const uint32_t *>(
+        column("positions", sizeof(uint32_t), n_positions));
+    out.strings = column("strings", 1, n_strings);
+    out.offsets = reinterpret_cast<const uint32_t *>(
+        column("offsets", sizeof(uint32_t), n_offsets));
+    if (!out.scores || !out.engines || !out.positions || !out.strings ||
+        !out.offsets)
+        return false;
+    out.size = static_cast<uint32_t>(n_scores);
+    if (n_engines != out.size || n_positions != out.size ||
+        n_offsets != size_t(out.size) * string_fields + 1 ||
+        out.offsets[n_offsets - 1] > n_strings)
+        return false;
+    for (size_t i = 1; i < n_offsets; i++)
+        if (out.offsets[i] < out.offsets[i - 1])
+            return false;
+    return true;
+}
+
+void register_result_module() {
+    batch_class->set_finalizer(js_batch_finalizer);
+    batch_class->set_gc_marker(js_batch_gc_mark);
+    batch_class->add_fn("push", js_batch_push, 6);
+    batch_class->add_fn("url", js_batch_get_string<0>, 1);
+    batch_class->add_fn("title", js_batch_get_string<1>, 1);
+    batch_class->add_fn("content", js_batch_get_string<2>, 1);
+    batch_class->add_fn("order", js_batch_order);
+    batch_class->add_fn("clear", js_batch_clear);
+    batch_class->add_getset("length", js_batch_get_length, nullptr);
+    batch_class->add_getset("scores", js_batch_get_view<view_scores>,
+                            nullptr);
+    batch_class->add_getset("engines", js_batch_get_view<view_engines>,
+                            nullptr);
+    batch_class->add_getset("positions", js_batch_get_view<view_positions>,
+                            nullptr);
+    batch_class->add_getset("strings", js_batch_get_view<view_strings>,
+                            nullptr);
+    batch_class->add_getset("offsets", js_batch_get_view<view_offsets>,
+                            nullptr);
+
+    Module module;
+    module.add_fn("createBatch", js_create_batch);
+    module.add_obj("ResultBatch", batch_class);
+    register_module("searxpp:result", module);
+}
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <quickjs.h>
+
+namespace lany {
+namespace js {
+
+// Registers the "searxpp:result" builtin module.
+//
+//   import { createBatch } from "searxpp:result";
+//   const batch = createBatch();
+//   batch.push(score, engineId, position, url, title, content);
+//                                       // score must be finite
+//   const scores = batch.scores;        // Float64Array
+//   for (const i of batch.order()) ... // indices by descending score
+//
+// Results are stored column-wise: scores, engine ids and positions in
+// native arrays exposed as TypedArrays, and the url/title/content strings
+// in one shared UTF-8 buffer addressed through `offsets` (three entries
+// per result plus a terminator). No JS object is allocated per result.
+//
+// TypedArrays returned by the getters stay valid snapshots; appending past
+// the current capacity moves the batch to new storage.
+//
+// An engine may return a batch from its search function. Its payload is
+// then written straight from the columns in ranked order, without a JS
+// object per result; see write_ranked_batch.
+void register_result_module();
+
+// Columns of a ranked batch payload, pointing into the value it was read
+// from. Result i has string fields url, title and content, field f spanning
+// strings[offsets[3 * i + f], offsets[3 * i + f + 1]).
+struct RankedColumns {
+    const double *scores = nullptr;
+    const uint32_t *engines = nullptr;
+    const uint32_t *positions = nullptr;
+    const uint8_t *strings = nullptr;
+    const uint32_t *offsets = nullptr;
+    uint32_t size = 0;
+
+    inline std::string_view string(uint32_t i, uint32_t field) const {
+        uint32_t slot = i * 3 + field;
+        return {reinterpret_cast<const char *>(strings) + offsets[slot],
+                offsets[slot + 1] - offsets[slot]};
+    }
+};
+
+// If `val` is a ResultBatch, sets `payload` to an object of the typed
+// arrays scores, engines, positions, strings and offsets in JS_WriteObject
+// format, ordered by descending score with ties by position, and returns 1.
+// Returns 0 for any other value and -1 with an exception pending if the
+// payload could not be written.
+int write_ranked_batch(JSContext *ctx, JSValueConst val,
+                       std::string &payload);
+// Fills `out` from a payload written by write_ranked_batch and read back
+// with JS_ReadObject. Returns false for any other value.
+bool read_ranked_batch(JSContext *ctx, JSValueConst val, RankedColumns &out);
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,97 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+
+namespace lany {
+namespace js {
+
+Scheduler::Scheduler() = default;
+Scheduler::Scheduler(const Options &opts) : opts(opts) {}
+
+void Scheduler::update_quota() {
+    if (total_priority == 0)
+        return;
+    for (auto &[ctx, entry] : entries) {
+        entry.quota = std::max<uint32_t>(
+            1, opts.slice_jobs * entry.priority / total_priority);
+    }
+}
+
+void Scheduler::add(JSContext *ctx, uint32_t priority) {
+    priority = std::max<uint32_t>(1, priority);
+    auto [it, inserted] = entries.try_emplace(ctx);
+    if (!inserted)
+        total_priority -= it->second.priority;
+    it->second.priority = priority;
+    if (inserted)
+        it->second.queued = clock::now();
+    total_priority += priority;
+    update_quota();
+}
+
+void Scheduler::remove(JSContext *ctx) {
+    auto it = entries.find(ctx);
+    if (it == entries.end())
+        return;
+    total_priority -= it->second.priority;
+    entries.erase(it);
+    update_quota();
+}
+
+void Scheduler::set_priority(JSContext *ctx, uint32_t priority) {
+    if (entries.find(ctx) != entries.end())
+        add(ctx, priority);
+}
+
+const SchedStats *Scheduler::stats(JSContext *ctx) const {
+    auto it = entries.find(ctx);
+    return it == entries.end() ? nullptr : &it->second.stats;
+}
+
+void Scheduler::enqueued(JSContext *ctx, clock::time_point at) {
+    auto it = entries.find(ctx);
+    if (it != entries.end())
+        it->second.queued = std::max(it->second.queued, at);
+}
+
+void Scheduler::begin_slice() {
+    slice_start = clock::now();
+    slice_jobs = 0;
+    over_quota = false;
+    for (auto &[ctx, entry] : entries)
+        entry.used = 0;
+}
+
+bool Scheduler::has_budget() const {
+    if (over_quota || slice_jobs >= opts.slice_jobs)
+        return false;
+    return clock::now() - slice_start < opts.slice_time;
+}
+
+void Scheduler::account(JSContext *ctx, clock::time_point start,
+                        clock::time_point end, uint64_t alloc_bytes) {
+    slice_jobs++;
+    auto it = entries.find(ctx);
+    if (it == entries.end())
+        return;
+    auto &entry = it->second;
+    auto &stats = entry.stats;
+    if (entry.used == 0)
+        stats.slices++;
+    auto wait = std::max<std::chrono::nanoseconds>(
+        std::chrono::nanoseconds(0), start - entry.queued);
+    stats.wait_time += wait;
+    stats.max_wait = std::max<std::chrono::nanoseconds>(stats.max_wait, wait);
+    // anything this job queued for its own entry point is ready now
+    entry.queued = end;
+    stats.jobs++;
+    stats.run_time += end - start;
+    stats.alloc_bytes += alloc_bytes;
+    if (++entry.used >= entry.quota && entries.size() > 1) {
+        stats.yields++;
+        over_quota = true;
+    }
+}
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+#include <quickjs.h>
+
+namespace lany {
+namespace js {
+
+struct SchedStats {
+    uint64_t jobs = 0;
+    uint64_t slices = 0;
+    uint64_t yields = 0;
+    uint64_t alloc_bytes = 0;
+    std::chrono::nanoseconds run_time{0};
+    // time jobs spent queued before they ran, counted from when they were
+    // enqueued or, for jobs a script queued itself, from the end of the
+    // entry point's previous job
+    std::chrono::nanoseconds wait_time{0};
+    std::chrono::nanoseconds max_wait{0};
+};
+
+// Splits the runtime job queue into bounded slices and accounts every job to
+// the EntryPoint (context) it ran in.
+//
+// All contexts of a Core share one JSRuntime, so QuickJS keeps a single FIFO
+// job queue and jobs cannot be reordered from outside. Fairness is enforced
+// by bounding each slice instead: an entry point that exceeds its
+// priority-weighted quota ends the slice early, handing control back to the
+// caller before it can monopolize the runtime.
+class Scheduler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Options {
+        uint32_t slice_jobs = 256;
+        std::chrono::microseconds slice_time{2000};
+    };
+
+private:
+    struct Entry {
+        uint32_t priority = 1;
+        uint32_t quota = 1;
+        uint32_t used = 0;
+        // latest time the next job of this entry point can have been queued
+        clock::time_point queued;
+        SchedStats stats;
+    };
+
+    Options opts;
+    std::unordered_map<JSContext *, Entry> entries;
+    uint64_t total_priority = 0;
+    clock::time_point slice_start;
+    uint32_t slice_jobs = 0;
+    bool over_quota = false;
+
+    void update_quota();
+
+public:
+    Scheduler();
+    Scheduler(const Options &opts);
+
+    void add(JSContext *ctx, uint32_t priority = 1);
+    void remove(JSContext *ctx);
+    void set_priority(JSContext *ctx, uint32_t priority);
+    const SchedStats *stats(JSContext *ctx) const;
+    // Records that native code queued a job for `ctx`, e.g. by settling one
+    // of its promises, so the job's wait is measured from `at`.
+    void enqueued(JSContext *ctx, clock::time_point at = clock::now());
+
+    void begin_slice();
+    bool has_budget() const;
+    void account(JSContext *ctx, clock::time_point start,
+                 clock::time_point end, uint64_t alloc_bytes = 0);
+};
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,243 @@
+#include "text.hpp"
+#include "module.hpp"
+#include "util/utf8.hpp"
+
+#include <string>
+#include <vector>
+
+#include <quickjs.h>
+
+namespace {
+
+using namespace lany;
+
+// Byte view of a JS string (as UTF-8) or of a buffer's memory.
+class Bytes {
+    JSContext *ctx;
+    const char *cstr = nullptr;
+
+public:
+    uint8_t *data = nullptr;
+    size_t size = 0;
+    bool is_string = false;
+
+    Bytes(JSContext *ctx) : ctx(ctx) {}
+    Bytes(const Bytes &) = delete;
+    ~Bytes() {
+        if (cstr)
+            JS_FreeCString(ctx, cstr);
+    }
+
+    int load(JSValueConst val) {
+        if (JS_IsString(val)) {
+            is_string = true;
+            cstr = JS_ToCStringLen(ctx, &size, val);
+            data = reinterpret_cast<uint8_t *>(const_cast<char *>(cstr));
+            return cstr ? 0 : -1;
+        }
+        data = JS_GetArrayBuffer(ctx, &size, val);
+        if (data)
+            return 0;
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        size_t offset, bytes_per_element, ab_size;
+        JSValue ab = JS_GetTypedArrayBuffer(ctx, val, &offset, &size,
+                                            &bytes_per_element);
+        if (JS_IsException(ab))
+            return -1;
+        data = JS_GetArrayBuffer(ctx, &ab_size, ab);
+        JS_FreeValue(ctx, ab);
+        if (!data)
+            return -1;
+        data += offset;
+        return 0;
+    }
+
+    std::string_view view() const {
+        return {reinterpret_cast<const char *>(data), size};
+    }
+};
+
+JSValue call_method(JSContext *ctx, JSValueConst obj, const char *name,
+                    int argc, JSValueConst *argv) {
+    JSValue fn = JS_GetPropertyStr(ctx, obj, name);
+    if (JS_IsException(fn))
+        return fn;
+    JSValue ret = JS_Call(ctx, fn, obj, argc, argv);
+    JS_FreeValue(ctx, fn);
+    return ret;
+}
+
+JSValue nfkc(JSContext *ctx, JSValueConst str) {
+    JSValue form = JS_NewString(ctx, "NFKC");
+    JSValue ret = call_method(ctx, str, "normalize", 1, &form);
+    JS_FreeValue(ctx, form);
+    return ret;
+}
+
+JSValue js_text_validate(JSContext *ctx, JSValueConst this_val, int argc,
+                         JSValueConst *argv) {
+    if (argc < 1)
+        return JS_ThrowTypeError(ctx, "validate expects a buffer");
+    if (JS_IsString(argv[0]))
+        return JS_TRUE;
+    Bytes in(ctx);
+    if (in.load(argv[0]) < 0)
+        return JS_EXCEPTION;
+    return JS_NewBool(ctx, util::validate_utf8(in.data, in.size));
+}
+
+JSValue js_text_normalize(JSContext *ctx, JSValueConst this_val, int argc,
+                          JSValueConst *argv) {
+    if (argc < 1 || !JS_IsString(argv[0]))
+        return JS_ThrowTypeError(ctx, "normalize expects a string");
+    Bytes in(ctx);
+    if (in.load(argv[0]) < 0)
+        return JS_EXCEPTION;
+    if (util::is_ascii(in.data, in.size))
+        return JS_DupValue(ctx, argv[0]);
+    return nfkc(ctx, argv[0]);
+}
+
+JSValue js_text_fold(JSContext *ctx, JSValueConst this_val, int argc,
+                     JSValueConst *argv) {
+    if (argc < 1)
+        return JS_ThrowTypeError(ctx, "fold expects a string or buffer");
+    Bytes in(ctx);
+    if (in.load(argv[0]) < 0)
+        return JS_EXCEPTION;
+    if (!in.is_string) {
+        util::ascii_lower(in.data, in.size, in.data);
+        return JS_UNDEFINED;
+    }
+    if (util::is_ascii(in.data, in.size)) {
+        std::string out(in.size, '\0');
+        util::ascii_lower(in.data, in.size,
+                          reinterpret_cast<uint8_t *>(out.data()));
+        return JS_NewStringLen(ctx, out.data(), out.size());
+    }
+    JSValue norm = nfkc(ctx, argv[0]);
+    if (JS_IsException(norm))
+        return norm;
+    JSValue ret = call_method(ctx, norm, "toLowerCase", 0, nullptr);
+    JS_FreeValue(ctx, norm);
+    return ret;
+}
+
+JSValue js_text_tokenize(JSContext *ctx, JSValueConst this_val, int argc,
+                         JSValueConst *argv) {
+    if (argc < 1)
+        return JS_ThrowTypeError(ctx, "tokenize expects a string or buffer");
+    Bytes in(ctx);
+    if (in.load(argv[0]) < 0)
+        return JS_EXCEPTION;
+    std::vector<util::token_span> tokens;
+    util::tokenize(in.view(), tokens);
+
+    if (!in.is_string) {
+        JSValue ab = JS_NewArrayBufferCopy(
+            ctx, reinterpret_cast<const uint8_t *>(tokens.data()),
+            tokens.size() * sizeof(util::token_span));
+        if (JS_IsException(ab))
+            return ab;
+        JSValue global = JS_GetGlobalObject(ctx);
+        JSValue ctor = JS_GetPropertyStr(ctx, global, "Uint32Array");
+        JSValue ret = JS_CallConstructor(ctx, ctor, 1, &ab);
+        JS_FreeValue(ctx, ctor);
+        JS_FreeValue(ctx, global);
+        JS_FreeValue(ctx, ab);
+        return ret;
+    }
+
+    JSValue ret = JS_NewArray(ctx);
+    if (JS_IsException(ret))
+        return ret;
+    for (uint32_t i = 0; i < tokens.size(); i++) {
+        auto [begin, end] = tokens[i];
+        JSValue token = JS_NewStringLen(
+            ctx, reinterpret_cast<const char *>(in.data) + begin, end - begin);
+        if (JS_IsException(token) ||
+            JS_SetPropertyUint32(ctx, ret, i, token) < 0) {
+            JS_FreeValue(ctx, ret);
+            return JS_EXCEPTION;
+        }
+    }
+    return ret;
+}
+
+int add_terms(JSContext *ctx, JSValueConst val,
+              std::vector<std::string> &terms) {
+    Bytes in(ctx);
+    if (in.load(val) < 0)
+        return -1;
+    std::vector<util::token_span> tokens;
+    util::tokenize(in.view(), tokens);
+    for (auto [begin, end] : tokens) {
+        auto &term = terms.emplace_back(in.view().substr(begin, end - begin));
+        util::ascii_lower(reinterpret_cast<uint8_t *>(term.data()),
+                          term.size(),
+                          reinterpret_cast<uint8_t *>(term.data()));
+    }
+    return 0;
+}
+
+// highlight(text, terms, open = "<mark>", close = "</mark>")
+JSValue js_text_highlight(JSContext *ctx, JSValueConst this_val, int argc,
+                          JSValueConst *argv) {
+    if (argc < 2)
+        return JS_ThrowTypeError(ctx, "highlight expects text and terms");
+
+    std::vector<std::string> terms;
+    if (JS_IsArray(ctx, argv[1])) {
+        JSValue len_val = JS_GetPropertyStr(ctx, argv[1], "length");
+        uint32_t len;
+        int err = JS_ToUint32(ctx, &len, len_val);
+        JS_FreeValue(ctx, len_val);
+        if (err < 0)
+            return JS_EXCEPTION;
+        for (uint32_t i = 0; i < len; i++) {
+            JSValue item = JS_GetPropertyUint32(ctx, argv[1], i);
+            err = add_terms(ctx, item, terms);
+            JS_FreeValue(ctx, item);
+            if (err < 0)
+                return JS_EXCEPTION;
+        }
+    } else if (add_terms(ctx, argv[1], terms) < 0) {
+        return JS_EXCEPTION;
+    }
+
+    Bytes text(ctx), open(ctx), close(ctx);
+    if (text.load(argv[0]) < 0)
+        return JS_EXCEPTION;
+    std::string_view open_tag = "<mark>", close_tag = "</mark>";
+    if (argc > 2 && !JS_IsUndefined(argv[2])) {
+        if (open.load(argv[2]) < 0)
+            return JS_EXCEPTION;
+        open_tag = open.view();
+    }
+    if (argc > 3 && !JS_IsUndefined(argv[3])) {
+        if (close.load(argv[3]) < 0)
+            return JS_EXCEPTION;
+        close_tag = close.view();
+    }
+
+    auto ret = util::highlight(text.view(), terms, open_tag, close_tag);
+    return JS_NewStringLen(ctx, ret.data(), ret.size());
+}
+
+} // namespace
+
+namespace lany {
+namespace js {
+
+void register_text_module() {
+    Module module;
+    module.add_fn("validate", js_text_validate, 1);
+    module.add_fn("normalize", js_text_normalize, 1);
+    module.add_fn("fold", js_text_fold, 1);
+    module.add_fn("tokenize", js_text_tokenize, 1);
+    module.add_fn("highlight", js_text_highlight, 4);
+    register_module("searxpp:text", module);
+}
+
+} // namespace js
+} // namespace lany
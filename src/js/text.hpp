@@ -0,0 +1,23 @@
+#pragma once
+
+namespace lany {
+namespace js {
+
+// Registers the "searxpp:text" builtin module.
+//
+//   validate(buf)               UTF-8 validation of an ArrayBuffer/TypedArray
+//   fold(str)                   NFKC + lowercase
+//   fold(buf)                   lowercases ASCII letters of a buffer in place
+//   normalize(str)              NFKC
+//   tokenize(str)               array of tokens
+//   tokenize(buf)               Uint32Array of [begin, end) byte offsets
+//   highlight(text, terms, open = "<mark>", close = "</mark>")
+//                               HTML-escaped text with matching tokens
+//                               wrapped in open/close
+//
+// ASCII input takes a native SIMD path; only strings with non-ASCII
+// characters fall back to String.prototype.normalize/toLowerCase.
+void register_text_module();
+
+} // namespace js
+} // namespace lany
@@ -0,0 +1,700 @@
+#include "worker.hpp"
+#include "jsc.hpp"
+#include "module.hpp"
+#include "util/log.hpp"
+#include "util/thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <quickjs.h>
+
+namespace {
+
+using namespace lany;
+
+// Reference counted native memory backing ArrayBuffers created by `alloc` or
+// received through a transfer. Moving one between runtimes only moves a
+// reference.
+struct NativeBuffer {
+    std::atomic<uint32_t> refs{1};
+    size_t size = 0;
+    uint8_t *data = nullptr;
+};
+
+std::mutex buffer_mtx;
+std::unordered_map<const uint8_t *, NativeBuffer *> buffer_map;
+
+NativeBuffer *new_buffer(size_t size) {
+    auto buf = new NativeBuffer;
+    buf->size = size;
+    buf->data = new uint8_t[size ? size : 1]();
+    std::lock_guard lock(buffer_mtx);
+    buffer_map.emplace(buf->data, buf);
+    return buf;
+}
+
+void release_buffer(NativeBuffer *buf) {
+    if (buf->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    {
+        std::lock_guard lock(buffer_mtx);
+        buffer_map.erase(buf->data);
+    }
+    delete[] buf->data;
+    delete buf;
+}
+
+NativeBuffer *find_buffer(const uint8_t *data) {
+    std::lock_guard lock(buffer_mtx);
+    auto it = buffer_map.find(data);
+    if (it == buffer_map.end())
+        return nullptr;
+    it->second->refs.fetch_add(1, std::memory_order_relaxed);
+    return it->second;
+}
+
+void free_array_buffer(JSRuntime *, void *opaque, void *) {
+    release_buffer(static_cast<NativeBuffer *>(opaque));
+}
+
+// Consumes one reference of `buf`.
+JSValue wrap_buffer(JSContext *ctx, NativeBuffer *buf) {
+    JSValue ab = JS_NewArrayBuffer(ctx, buf->data, buf->size,
+                                   free_array_buffer, buf, false);
+    if (JS_IsException(ab))
+        release_buffer(buf);
+    return ab;
+}
+
+// Moves the contents of an ArrayBuffer out of its runtime and detaches it.
+NativeBuffer *take_buffer(JSContext *ctx, JSValueConst val) {
+    size_t size;
+    uint8_t *data = JS_GetArrayBuffer(ctx, &size, val);
+    if (!data)
+        return nullptr;
+    NativeBuffer *buf = find_buffer(data);
+    if (!buf) {
+        buf = new_buffer(size);
+        std::memcpy(buf->data, data, size);
+    }
+    JS_DetachArrayBuffer(ctx, val);
+    return buf;
+}
+
+struct Message {
+    uint64_t id = 0;
+    bool ok = true;
+    std::vector<uint8_t> data;
+    std::vector<NativeBuffer *> transfer;
+    // set for native tasks: builds the value on the runtime thread
+    std::function<JSValue(JSContext *)> build;
+
+    Message() = default;
+    Message(const Message &) = delete;
+    Message(Message &&) = default;
+    Message &operator=(Message &&) = default;
+    ~Message() {
+        for (auto buf : transfer)
+            release_buffer(buf);
+    }
+};
+
+int write_message(JSContext *ctx, JSValueConst val, Message &msg) {
+    size_t size;
+    uint8_t *buf = JS_WriteObject(ctx, &size, val, 0);
+    if (!buf)
+        return -1;
+    msg.data.assign(buf, buf + size);
+    js_free(ctx, buf);
+    return 0;
+}
+
+int take_transfer_list(JSContext *ctx, JSValueConst list, Message &msg) {
+    JSValue len_val = JS_GetPropertyStr(ctx, list, "length");
+    uint32_t len;
+    int err = JS_ToUint32(ctx, &len, len_val);
+    JS_FreeValue(ctx, len_val);
+    if (err < 0)
+        return -1;
+    for (uint32_t i = 0; i < len; i++) {
+        JSValue item = JS_GetPropertyUint32(ctx, list, i);
+        NativeBuffer *buf = take_buffer(ctx, item);
+        JS_FreeValue(ctx, item);
+        if (!buf)
+            return -1;
+        msg.transfer.push_back(buf);
+    }
+    return 0;
+}
+
+// Returns [data, transfer] read from `msg`, consuming its buffers.
+int read_message(JSContext *ctx, Message &msg, JSValue *out) {
+    out[0] = JS_ReadObject(ctx, msg.data.data(), msg.data.size(), 0);
+    if (JS_IsException(out[0]))
+        return -1;
+    out[1] = JS_NewArray(ctx);
+    for (uint32_t i = 0; i < msg.transfer.size(); i++) {
+        JSValue ab = wrap_buffer(ctx, msg.transfer[i]);
+        msg.transfer[i] = nullptr;
+        if (JS_IsException(ab) ||
+            JS_SetPropertyUint32(ctx, out[1], i, ab) < 0) {
+            for (auto &buf : msg.transfer) {
+                if (buf)
+                    release_buffer(buf);
+            }
+            msg.transfer.clear();
+            JS_FreeValue(ctx, out[0]);
+            JS_FreeValue(ctx, out[1]);
+            return -1;
+        }
+    }
+    msg.transfer.clear();
+    return 0;
+}
+
+std::string error_string(JSContext *ctx, JSValueConst val) {
+    std::string ret;
+    if (const char *str = JS_ToCString(ctx, val)) {
+        ret = str;
+        JS_FreeCString(ctx, str);
+    }
+    if (JS_IsError(ctx, val)) {
+        JSValue stack = JS_GetPropertyStr(ctx, val, "stack");
+        if (!JS_IsUndefined(stack)) {
+            if (const char *str = JS_ToCString(ctx, stack)) {
+                ret += '\n';
+                ret += str;
+                JS_FreeCString(ctx, str);
+            }
+        }
+        JS_FreeValue(ctx, stack);
+    }
+    return ret.empty() ? "unknown exception" : ret;
+}
+
+struct WorkerState;
+
+struct Pending {
+    JSContext *ctx;
+    JSValue resolve;
+    JSValue reject;
+    const WorkerState *owner;
+    // the search that created the promise
+    js::ActiveSearch search;
+};
+
+// argv: the search number and engine log id
+JSValue js_enter_search(JSContext *ctx, int argc, JSValueConst *argv) {
+    js::ActiveSearch search;
+    JS_ToInt64(ctx, &search.search, argv[0]);
+    JS_ToUint32(ctx, &search.engine, argv[1]);
+    js::set_active_search(JS_GetRuntime(ctx), search);
+    return JS_UNDEFINED;
+}
+
+JSValue js_leave_search(JSContext *ctx, int argc, JSValueConst *argv) {
+    js::set_active_search(JS_GetRuntime(ctx), {});
+    return JS_UNDEFINED;
+}
+
+// Bumped on every reply to any runtime, so a thread running several
+// runtimes can sleep until one of them has work.
+std::atomic<uint32_t> reply_epoch{0};
+
+// Replies addressed to one parent runtime. `replies` is filled by worker
+// threads; `pending` is only touched by the thread running the parent.
+struct Mailbox {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<Message> replies;
+    std::unordered_map<uint64_t, Pending> pending;
+    uint64_t next_id = 0;
+
+    void push(Message &&msg) {
+        {
+            std::lock_guard lock(mtx);
+            replies.emplace_back(std::move(msg));
+        }
+        cv.notify_one();
+        reply_epoch.fetch_add(1, std::memory_order_release);
+        reply_epoch.notify_all();
+    }
+
+    void settle(Pending &p, bool ok, JSValue val) {
+        // Jobs run in order, so the reactions queued by settling the promise
+        // run between these two and see p.search as the active search.
+        if (p.search) {
+            JSValue args[2] = {JS_NewInt64(p.ctx, p.search.search),
+                               JS_NewUint32(p.ctx, p.search.engine)};
+            JS_EnqueueJob(p.ctx, js_enter_search, 2, args);
+        }
+        JSValue ret =
+            JS_Call(p.ctx, ok ? p.resolve : p.reject, JS_UNDEFINED, 1, &val);
+        if (p.search)
+            JS_EnqueueJob(p.ctx, js_leave_search, 0, nullptr);
+        JS_FreeValue(p.ctx, ret);
+        JS_FreeValue(p.ctx, val);
+        free(p);
+    }
+
+    void free(Pending &p) {
+        JS_FreeValue(p.ctx, p.resolve);
+        JS_FreeValue(p.ctx, p.reject);
+        JS_FreeContext(p.ctx);
+    }
+};
+
+std::mutex mailbox_mtx;
+std::unordered_map<JSRuntime *, std::shared_ptr<Mailbox>> mailbox_map;
+
+std::shared_ptr<Mailbox> get_mailbox(JSRuntime *rt, bool create) {
+    std::lock_guard lock(mailbox_mtx);
+    auto it = mailbox_map.find(rt);
+    if (it != mailbox_map.end())
+        return it->second;
+    if (!create)
+        return nullptr;
+    return mailbox_map.emplace(rt, std::make_shared<Mailbox>()).first->second;
+}
+
+util::thread_pool &pool() {
+    static util::thread_pool p;
+    return p;
+}
+
+JSValue js_worker_transfer(JSContext *ctx, JSValueConst this_val, int argc,
+                           JSValueConst *argv);
+JSValue js_worker_done(JSContext *ctx, JSValueConst this_val, int argc,
+                       JSValueConst *argv, int magic, JSValue *func_data);
+
+constexpr char dispatch_src[] =
+    "(f, data, transfer, done) => Promise.resolve()"
+    ".then(() => f(data, transfer))"
+    ".then((v) => done(true, v), (e) => done(false, e))";
+
+struct WorkerState : std::enable_shared_from_this<WorkerState> {
+    std::string filename;
+    std::shared_ptr<Mailbox> mailbox;
+
+    std::mutex mtx;
+    std::deque<Message> inbox;
+    bool scheduled = false;
+    bool closed = false;
+
+    // Owned by whichever pool thread is currently draining the inbox.
+    JSRuntime *rt = nullptr;
+    std::unique_ptr<js::EntryPoint> ep;
+    JSValue dispatch = JS_UNDEFINED;
+    bool failed = false;
+    uint64_t current = 0;
+    bool answered = false;
+    std::vector<NativeBuffer *> reply_transfer;
+
+    WorkerState(const std::string &filename, std::shared_ptr<Mailbox> mailbox)
+        : filename(filename), mailbox(std::move(mailbox)) {}
+
+    ~WorkerState() {
+        for (auto buf : reply_transfer)
+            release_buffer(buf);
+        if (!rt)
+            return;
+        JS_UpdateStackTop(rt);
+        if (ep)
+            JS_FreeValue(ep->get_ctx(), dispatch);
+        js::release_workers(rt);
+        ep.reset();
+        JS_FreeRuntime(rt);
+    }
+
+    bool is_closed() {
+        std::lock_guard lock(mtx);
+        return closed;
+    }
+
+    void post(Message &&msg) {
+        bool schedule;
+        {
+            std::lock_guard lock(mtx);
+            inbox.emplace_back(std::move(msg));
+            schedule = !scheduled;
+            scheduled = true;
+        }
+        if (schedule)
+            pool().submit([self = shared_from_this()] { self->drain(); });
+    }
+
+    void close() {
+        std::lock_guard lock(mtx);
+        closed = true;
+        inbox.clear();
+    }
+
+    void reply_error(uint64_t id, const std::string &err) {
+        Message reply;
+        reply.id = id;
+        reply.ok = false;
+        reply.data.assign(err.begin(), err.end());
+        mailbox->push(std::move(reply));
+    }
+
+    bool init() {
+        rt = JS_NewRuntime();
+        if (!rt)
+            return false;
+        JS_SetRuntimeOpaque(rt, this);
+        ep = std::make_unique<js::EntryPoint>(rt);
+        JSContext *ctx = ep->get_ctx();
+        JSValue global = JS_GetGlobalObject(ctx);
+        JS_SetPropertyStr(
+            ctx, global, "transfer",
+            JS_NewCFunction(ctx, js_worker_transfer, "transfer", 1));
+        JS_FreeValue(ctx, global);
+        dispatch = JS_Eval(ctx, dispatch_src, sizeof(dispatch_src) - 1,
+                           "<worker>", JS_EVAL_TYPE_GLOBAL);
+        if (JS_IsException(dispatch)) {
+            ep->dump_error();
+            return false;
+        }
+        if (ep->eval_file(filename) < 0)
+            return false;
+        run_jobs();
+        return true;
+    }
+
+    // Runs the job queue until it is empty and no native promise, such as an
+    // http request, is outstanding.
+    void run_jobs() {
+        while (true) {
+            ep->loop();
+            if (!js::has_pending_workers(rt))
+                break;
+            js::poll_workers(rt, -1);
+        }
+    }
+
+    void handle(Message &msg) {
+        JSContext *ctx = ep->get_ctx();
+        current = msg.id;
+        answered = false;
+
+        JSValue args[4];
+        if (read_message(ctx, msg, &args[1]) < 0) {
+            JSValue exn = JS_GetException(ctx);
+            reply_error(msg.id, error_string(ctx, exn));
+            JS_FreeValue(ctx, exn);
+            return;
+        }
+        JSValue global = JS_GetGlobalObject(ctx);
+        args[0] = JS_GetPropertyStr(ctx, global, "onmessage");
+        JS_FreeValue(ctx, global);
+        JSValue id = JS_NewInt64(ctx, msg.id);
+        args[3] = JS_NewCFunctionData(ctx, js_worker_done, 2, 0, 1, &id);
+
+        JSValue ret = JS_Call(ctx, dispatch, JS_UNDEFINED, 4, args);
+        if (JS_IsException(ret))
+            ep->dump_error();
+        JS_FreeValue(ctx, ret);
+        for (auto &arg : args)
+            JS_FreeValue(ctx, arg);
+        run_jobs();
+
+        if (!answered) {
+            answered = true;
+            reply_error(msg.id, "worker handler did not settle");
+        }
+    }
+
+    void drain() {
+        while (true) {
+            Message msg;
+            {
+                std::lock_guard lock(mtx);
+                if (inbox.empty()) {
+                    scheduled = false;
+                    return;
+                }
+                msg = std::move(inbox.front());
+                inbox.pop_front();
+            }
+            if (!failed && !ep && !init()) {
+                LANY_LOG_ERROR("failed to start worker: {}", filename);
+                failed = true;
+            }
+            if (failed) {
+                reply_error(msg.id, "failed to start worker: " + filename);
+                continue;
+            }
+            JS_UpdateStackTop(rt);
+            handle(msg);
+        }
+    }
+};
+
+WorkerState *current_worker(JSContext *ctx) {
+    return static_cast<WorkerState *>(JS_GetRuntimeOpaque(JS_GetRuntime(ctx)));
+}
+
+JSValue js_worker_transfer(JSContext *ctx, JSValueConst this_val, int argc,
+                           JSValueConst *argv) {
+    WorkerState *state = current_worker(ctx);
+    if (argc < 1)
+        return JS_ThrowTypeError(ctx, "transfer expects an ArrayBuffer");
+    NativeBuffer *buf = take_buffer(ctx, argv[0]);
+    if (!buf)
+        return JS_EXCEPTION;
+    state->reply_transfer.push_back(buf);
+    return JS_UNDEFINED;
+}
+
+JSValue js_worker_done(JSContext *ctx, JSValueConst this_val, int argc,
+                       JSValueConst *argv, int magic, JSValue *func_data) {
+    WorkerState *state = current_worker(ctx);
+    int64_t id;
+    JS_ToInt64(ctx, &id, func_data[0]);
+    if (static_cast<uint64_t>(id) != state->current || state->answered)
+        return JS_UNDEFINED;
+    state->answered = true;
+
+    Message reply;
+    reply.id = id;
+    reply.transfer = std::move(state->reply_transfer);
+    state->reply_transfer.clear();
+    if (!JS_ToBool(ctx, argv[0])) {
+        state->reply_error(id, error_string(ctx, argv[1]));
+        return JS_UNDEFINED;
+    }
+    if (write_message(ctx, argv[1], reply) < 0) {
+        JSValue exn = JS_GetException(ctx);
+        state->reply_error(id, error_string(ctx, exn));
+        JS_FreeValue(ctx, exn);
+        return JS_UNDEFINED;
+    }
+    state->mailbox->push(std::move(reply));
+    return JS_UNDEFINED;
+}
+
+auto worker_class = std::make_shared<js::Class>("Worker");
+
+std::shared_ptr<WorkerState> *get_state(JSContext *ctx, JSValueConst val) {
+    return static_cast<std::shared_ptr<WorkerState> *>(
+        JS_GetOpaque2(ctx, val, worker_class->get_class_id()));
+}
+
+void js_worker_finalizer(JSRuntime *rt, JSValue val) {
+    // Requests already posted still complete; the state is freed by the
+    // last pool task holding it.
+    delete static_cast<std::shared_ptr<WorkerState> *>(
+        JS_GetOpaque(val, worker_class->get_class_id()));
+}
+
+JSValue js_worker_spawn(JSContext *ctx, JSValueConst this_val, int argc,
+                        JSValueConst *argv) {
+    if (argc < 1)
+        return JS_ThrowTypeError(ctx, "spawn expects a script path");
+    // a worker waiting on its own pool could exhaust it and deadlock
+    if (current_worker(ctx))
+        return JS_ThrowTypeError(ctx, "spawn is not available in a worker");
+    const char *filename = JS_ToCString(ctx, argv[0]);
+    if (!filename)
+        return JS_EXCEPTION;
+    auto state = std::make_shared<WorkerState>(
+        filename, get_mailbox(JS_GetRuntime(ctx), true));
+    JS_FreeCString(ctx, filename);
+
+    JSValue obj = JS_NewObjectClass(ctx, worker_class->get_class_id());
+    if (JS_IsException(obj))
+        return obj;
+    JS_SetOpaque(obj, new std::shared_ptr<WorkerState>(std::move(state)));
+    return obj;
+}
+
+JSValue js_worker_post(JSContext *ctx, JSValueConst this_val, int argc,
+                       JSValueConst *argv) {
+    auto state = get_state(ctx, this_val);
+    if (!state)
+        return JS_EXCEPTION;
+    if ((*state)->is_closed())
+        return JS_ThrowTypeError(ctx, "worker is terminated");
+
+    Message msg;
+    if (write_message(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, msg) < 0)
+        return JS_EXCEPTION;
+    if (argc > 1 && !JS_IsUndefined(argv[1]) &&
+        take_transfer_list(ctx, argv[1], msg) < 0)
+        return JS_EXCEPTION;
+
+    JSValue funcs[2];
+    JSValue promise = JS_NewPromiseCapability(ctx, funcs);
+    if (JS_IsException(promise))
+        return promise;
+    auto &mailbox = (*state)->mailbox;
+    msg.id = ++mailbox->next_id;
+    mailbox->pending.emplace(
+        msg.id, Pending{JS_DupContext(ctx), funcs[0], funcs[1], state->get(),
+                        js::active_search(JS_GetRuntime(ctx))});
+    (*state)->post(std::move(msg));
+    return promise;
+}
+
+JSValue js_worker_terminate(JSContext *ctx, JSValueConst this_val, int argc,
+                            JSValueConst *argv) {
+    auto state = get_state(ctx, this_val);
+    if (!state)
+        return JS_EXCEPTION;
+    (*state)->close();
+    auto &mailbox = (*state)->mailbox;
+    for (auto it = mailbox->pending.begin(); it != mailbox->pending.end();) {
+        if (it->second.owner != state->get()) {
+            ++it;
+            continue;
+        }
+        Pending p = it->second;
+        it = mailbox->pending.erase(it);
+        JS_ThrowInternalError(p.ctx, "worker is terminated");
+        mailbox->settle(p, false, JS_GetException(p.ctx));
+    }
+    return JS_UNDEFINED;
+}
+
+JSValue js_worker_alloc(JSContext *ctx, JSValueConst this_val, int argc,
+                        JSValueConst *argv) {
+    uint64_t size;
+    if (JS_ToIndex(ctx, &size, argc > 0 ? argv[0] : JS_UNDEFINED) < 0)
+        return JS_EXCEPTION;
+    return wrap_buffer(ctx, new_buffer(size));
+}
+
+} // namespace
+
+namespace lany {
+namespace js {
+
+void register_worker_module() {
+    worker_class->set_finalizer(js_worker_finalizer);
+    worker_class->add_fn("post", js_worker_post, 2);
+    worker_class->add_fn("terminate", js_worker_terminate);
+
+    Module module;
+    module.add_fn("spawn", js_worker_spawn, 1);
+    module.add_fn("alloc", js_worker_alloc, 1);
+    module.add_obj("Worker", worker_class);
+    register_module("searxpp:worker", module);
+}
+
+int poll_workers(JSRuntime *rt, int timeout_ms, Scheduler *sched) noexcept {
+    auto mailbox = get_mailbox(rt, false);
+    if (!mailbox)
+        return 0;
+
+    std::deque<Message> ready;
+    {
+        std::unique_lock lock(mailbox->mtx);
+        auto has_reply = [&] { return !mailbox->replies.empty(); };
+        if (timeout_ms < 0 && !mailbox->pending.empty())
+            mailbox->cv.wait(lock, has_reply);
+        else if (timeout_ms > 0 && !mailbox->pending.empty())
+            mailbox->cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                 has_reply);
+        ready.swap(mailbox->replies);
+    }
+
+    int count = 0;
+    for (auto &msg : ready) {
+        auto it = mailbox->pending.find(msg.id);
+        if (it == mailbox->pending.end())
+            continue;
+        Pending p = it->second;
+        mailbox->pending.erase(it);
+        count++;
+
+        JSContext *ctx = p.ctx;
+        if (sched)
+            sched->enqueued(ctx);
+        if (msg.build) {
+            JSValue val = msg.build(ctx);
+            if (JS_IsException(val))
+                mailbox->settle(p, false, JS_GetException(ctx));
+            else
+                mailbox->settle(p, true, val);
+            continue;
+        }
+        if (!msg.ok) {
+            std::string err(msg.data.begin(), msg.data.end());
+            LANY_LOG(WARN, p.search.engine, "worker request failed: {}", err);
+            JS_ThrowInternalError(ctx, "%s", err.c_str());
+            mailbox->settle(p, false, JS_GetException(ctx));
+            continue;
+        }
+        JSValue parts[2];
+        if (read_message(ctx, msg, parts) < 0) {
+            mailbox->settle(p, false, JS_GetException(ctx));
+            continue;
+        }
+        JSValue ret = JS_NewObject(ctx);
+        JS_DefinePropertyValueStr(ctx, ret, "data", parts[0], JS_PROP_C_W_E);
+        JS_DefinePropertyValueStr(ctx, ret, "transfer", parts[1],
+                                  JS_PROP_C_W_E);
+        mailbox->settle(p, true, ret);
+    }
+    return count;
+}
+
+JSValue new_native_promise(JSContext *ctx, NativeCompletion &complete) {
+    JSValue funcs[2];
+    JSValue promise = JS_NewPromiseCapability(ctx, funcs);
+    if (JS_IsException(promise))
+        return promise;
+    auto mailbox = get_mailbox(JS_GetRuntime(ctx), true);
+    uint64_t id = ++mailbox->next_id;
+    mailbox->pending.emplace(
+        id, Pending{JS_DupContext(ctx), funcs[0], funcs[1], nullptr,
+                    js::active_search(JS_GetRuntime(ctx))});
+    complete = [mailbox, id](std::function<JSValue(JSContext *)> build) {
+        Message msg;
+        msg.id = id;
+        msg.build = std::move(build);
+        mailbox->push(std::move(msg));
+    };
+    return promise;
+}
+
+uint32_t worker_reply_epoch() noexcept {
+    return reply_epoch.load(std::memory_order_acquire);
+}
+
+void wait_worker_reply(uint32_t epoch) noexcept {
+    reply_epoch.wait(epoch, std::memory_order_acquire);
+}
+
+bool has_pending_workers(JSRuntime *rt) noexcept {
+    auto mailbox = get_mailbox(rt, false);
+    return mailbox && !mailbox->pending.empty();
+}
+
+void release_workers(JSRuntime *rt) noexcept {
+    std::shared_ptr<Mailbox> mailbox;
+    {
+        std::lock_guard lock(mailbox_mtx);
+        auto it = mailbox_map.find(rt);
+        if (it == mailbox_map.end())
+            return;
+        mailbox = std::move(it->second);
+        mailbox_map.erase(it);
+    }
+    for (auto &[id, p] : mailbox->pending)
+        mailbox->free(p);
+    mailbox->pending.clear();
+}
+
+} // namespace js
+} // namespace lany
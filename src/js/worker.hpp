@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include <quickjs.h>
+
+namespace lany {
+namespace js {
+
+class Scheduler;
+
+// Registers the "searxpp:worker" builtin module.
+//
+//   import { spawn, alloc } from "searxpp:worker";
+//   const w = spawn("./parse.js");
+//   const { data, transfer } = await w.post(msg, [buffer]);
+//
+// Every worker runs its script in a private JSRuntime on a pooled thread and
+// answers messages through its global `onmessage(data, transfer)`. Messages
+// are copied with JS_WriteObject/JS_ReadObject; ArrayBuffers listed for
+// transfer are detached from the sender, and those created by `alloc` move
+// between runtimes without copying. Native promises such as http requests
+// settle inside workers as well; spawn itself throws there.
+void register_worker_module();
+
+// Resolves the promises of finished worker requests posted from `rt`.
+// While requests are outstanding, waits up to `timeout_ms` (-1 = forever)
+// for at least one reply. Settled contexts are reported to `sched`, if
+// given. Returns the number of requests settled.
+int poll_workers(JSRuntime *rt, int timeout_ms,
+                 Scheduler *sched = nullptr) noexcept;
+bool has_pending_workers(JSRuntime *rt) noexcept;
+// Counts replies delivered to any runtime. A thread driving several
+// runtimes reads it, polls each of them without waiting and, if none had a
+// reply, blocks in wait_worker_reply until the count moves on.
+uint32_t worker_reply_epoch() noexcept;
+void wait_worker_reply(uint32_t epoch) noexcept;
+
+// Hands a native task's result back to the runtime that started it. May be
+// called once, from any thread; poll_workers then settles the promise with
+// the value `build` returns on the runtime thread, or rejects it with the
+// pending exception if `build` returns JS_EXCEPTION.
+using NativeCompletion =
+    std::function<void(std::function<JSValue(JSContext *)> build)>;
+// Returns a promise for native asynchronous work and sets `complete` to its
+// completion handle. The promise counts as an outstanding worker request.
+JSValue new_native_promise(JSContext *ctx, NativeCompletion &complete);
+// Drops all outstanding requests of `rt`; must run before it is freed.
+void release_workers(JSRuntime *rt) noexcept;
+
+} // namespace js
+} // namespace lany
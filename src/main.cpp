@@ -0,0 +1,343 @@
+#include "ipc/shard.hpp"
+#include "js/builtins.hpp"
+#include "js/jsc.hpp"
+#include "js/result_batch.hpp"
+#include "store/history.hpp"
+#include "util/log.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <quickjs.h>
+
+namespace {
+
+using namespace lany;
+
+struct Options {
+    std::string shard;
+    std::string coordinator;
+    int shards = 1;
+    int timeout_ms = 10000;
+    bool isolate = false;
+    std::string binary_log;
+    std::string decode_log;
+    std::string history;
+    // engine name and the one in `n` of its records to keep
+    std::vector<std::pair<std::string, uint32_t>> log_samples;
+    std::vector<std::string> files;
+};
+
+void usage() {
+    std::fprintf(
+        stderr,
+        "usage: searxpp [options] script.js...\n"
+        "  --shard SOCKET        serve the scripts' engines to the\n"
+        "                        coordinator listening on SOCKET\n"
+        "  --coordinator SOCKET  listen on SOCKET, wait for the shards and\n"
+        "                        search every query read from stdin\n"
+        "  --shards N            shards to wait for (default 1)\n"
+        "  --timeout MS          per-query deadline (default 10000)\n"
+        "  --isolate             give every script its own runtime\n"
+        "  --binary-log FILE     write the log to FILE in binary form\n"
+        "  --decode-log FILE     print a binary log as text and exit\n"
+        "  --log-sample ENGINE=N keep one in N of ENGINE's records below\n"
+        "                        error level\n"
+        "  --history DIR         record queries, latencies and results\n"
+        "                        of the coordinator in DIR\n");
+}
+
+// "ENGINE=N"
+bool parse_log_sample(std::string_view spec, Options &opts) {
+    size_t eq = spec.rfind('=');
+    if (eq == 0 || eq == std::string_view::npos)
+        return false;
+    uint32_t n = std::strtoul(spec.data() + eq + 1, nullptr, 10);
+    if (n == 0)
+        return false;
+    opts.log_samples.emplace_back(spec.substr(0, eq), n);
+    return true;
+}
+
+bool parse_args(int argc, char **argv, Options &opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            opts.files.push_back(arg);
+            continue;
+        }
+        if (arg == "--isolate") {
+            opts.isolate = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *val = argv[++i];
+        if (arg == "--shard")
+            opts.shard = val;
+        else if (arg == "--coordinator")
+            opts.coordinator = val;
+        else if (arg == "--shards")
+            opts.shards = std::atoi(val);
+        else if (arg == "--timeout")
+            opts.timeout_ms = std::atoi(val);
+        else if (arg == "--binary-log")
+            opts.binary_log = val;
+        else if (arg == "--decode-log")
+            opts.decode_log = val;
+        else if (arg == "--history")
+            opts.history = val;
+        else if (arg != "--log-sample" || !parse_log_sample(val, opts))
+            return false;
+    }
+    if (!opts.decode_log.empty())
+        return true;
+    if (!opts.coordinator.empty())
+        return opts.shards > 0 && opts.shard.empty();
+    return !opts.files.empty();
+}
+
+int decode_log(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", path.c_str());
+        return 1;
+    }
+    if (util::log::decode(in, std::cout) < 0) {
+        std::fprintf(stderr, "%s: not a binary log or truncated\n",
+                     path.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int run_scripts(const Options &opts) {
+    if (!opts.isolate) {
+        js::Core core;
+        core.prefetch(opts.files);
+        for (auto &file : opts.files)
+            if (core.add_file(file) < 0)
+                return 1;
+        return core.loop_all() < 0 ? 1 : 0;
+    }
+
+    // separate job queues, interleaved slice by slice
+    std::vector<js::Core> cores(opts.files.size());
+    std::vector<js::Core *> ptrs;
+    for (size_t i = 0; i < cores.size(); i++) {
+        cores[i].prefetch({opts.files[i]});
+        if (cores[i].add_file(opts.files[i]) < 0)
+            return 1;
+        ptrs.push_back(&cores[i]);
+    }
+    return js::Core::loop_all(ptrs) < 0 ? 1 : 0;
+}
+
+int run_shard(const Options &opts) {
+    ipc::ShardWorker worker;
+    worker.get_core().prefetch(opts.files);
+    for (auto &file : opts.files)
+        if (worker.add_file(file) < 0)
+            return 1;
+    return worker.run(opts.shard) < 0 ? 1 : 0;
+}
+
+// Engines are recorded in the history by a hash of their name, which stays
+// stable across restarts and shard layouts.
+uint32_t engine_id(const std::string &engine) {
+    return static_cast<uint32_t>(store::fingerprint(engine));
+}
+
+void append_json_string(std::string &out, std::string_view str) {
+    out += '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += fmt::format("\\u{:04x}", c);
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// The JSON a ranked batch payload would stringify to as an array of
+// { url, title, content, score, engine, position }, built from the columns.
+std::string batch_json(const js::RankedColumns &cols) {
+    static const char *const fields[] = {"url", "title", "content"};
+    std::string out = "[";
+    for (uint32_t i = 0; i < cols.size; i++) {
+        out += i ? ",{" : "{";
+        for (uint32_t f = 0; f < 3; f++) {
+            out += fmt::format("\"{}\":", fields[f]);
+            append_json_string(out, cols.string(i, f));
+            out += ',';
+        }
+        out += fmt::format("\"score\":{},\"engine\":{},\"position\":{}}}",
+                           cols.scores[i], cols.engines[i],
+                           cols.positions[i]);
+    }
+    out += ']';
+    return out;
+}
+
+// Prints a result as "engine<TAB>json" or "engine<TAB>error: message" and
+// records the url of every result in `history`.
+void print_result(JSContext *ctx, const std::string &engine, bool ok,
+                  const std::string &payload, store::HistoryWriter *history,
+                  uint64_t query_id) {
+    if (!ok) {
+        std::printf("%s\terror: %s\n", engine.c_str(), payload.c_str());
+        return;
+    }
+    JSValue val = JS_ReadObject(
+        ctx, reinterpret_cast<const uint8_t *>(payload.data()),
+        payload.size(), 0);
+    js::RankedColumns cols;
+    if (js::read_ranked_batch(ctx, val, cols)) {
+        std::printf("%s\t%s\n", engine.c_str(), batch_json(cols).c_str());
+        for (uint32_t i = 0; history && i < cols.size; i++)
+            history->log_result(query_id, engine_id(engine), i,
+                                store::fingerprint(cols.string(i, 0)));
+        JS_FreeValue(ctx, val);
+        return;
+    }
+    JSValue json = JS_JSONStringify(ctx, val, JS_UNDEFINED, JS_UNDEFINED);
+    const char *str = JS_IsException(json) ? nullptr
+                                            : JS_ToCString(ctx, json);
+    if (str) {
+        std::printf("%s\t%s\n", engine.c_str(), str);
+        JS_FreeCString(ctx, str);
+    } else {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        std::printf("%s\terror: unreadable result\n", engine.c_str());
+    }
+    JS_FreeValue(ctx, json);
+
+    uint32_t len = 0;
+    if (history && JS_IsArray(ctx, val) > 0) {
+        JSValue len_val = JS_GetPropertyStr(ctx, val, "length");
+        JS_ToUint32(ctx, &len, len_val);
+        JS_FreeValue(ctx, len_val);
+        for (uint32_t i = 0; i < len; i++) {
+            JSValue item = JS_GetPropertyUint32(ctx, val, i);
+            JSValue url = JS_GetPropertyStr(ctx, item, "url");
+            if (const char *s = JS_IsString(url) ? JS_ToCString(ctx, url)
+                                                   : nullptr) {
+                history->log_result(query_id, engine_id(engine), i,
+                                    store::fingerprint(s));
+                JS_FreeCString(ctx, s);
+            }
+            JS_FreeValue(ctx, url);
+            JS_FreeValue(ctx, item);
+        }
+    }
+    JS_FreeValue(ctx, val);
+}
+
+int run_coordinator(const Options &opts) {
+    ipc::Coordinator coordinator;
+    if (coordinator.listen(opts.coordinator) < 0)
+        return 1;
+    for (int i = 0; i < opts.shards; i++)
+        if (coordinator.accept_shard() < 0)
+            return 1;
+
+    // results arrive in JS_WriteObject format
+    JSRuntime *rt = JS_NewRuntime();
+    JSContext *ctx = JS_NewContext(rt);
+    std::unique_ptr<store::HistoryWriter> history;
+    if (!opts.history.empty())
+        history = std::make_unique<store::HistoryWriter>(opts.history);
+
+    auto clock_ns = [] {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count());
+    };
+    // unique across restarts without keeping state
+    uint64_t query_id = clock_ns();
+    int ret = 0;
+    for (std::string line; std::getline(std::cin, line);) {
+        if (line.empty())
+            continue;
+        query_id++;
+        auto start = std::chrono::steady_clock::now();
+        if (history)
+            history->log_query(query_id, line);
+        // late results are still printed, and recorded under their own
+        // query, while the next query runs
+        auto done = [&, id = query_id, start](const std::string &engine,
+                                              bool ok, std::string payload) {
+            if (history) {
+                auto latency =
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start);
+                history->log_latency(id, engine_id(engine),
+                                     static_cast<uint32_t>(latency.count()),
+                                     ok ? 0 : -1);
+            }
+            print_result(ctx, engine, ok, payload, history.get(), id);
+        };
+        if (coordinator.search(line, done) == 0)
+            std::printf("no engine available\n");
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(opts.timeout_ms);
+        int left = 1;
+        while (left > 0 && std::chrono::steady_clock::now() < deadline)
+            left = coordinator.poll(static_cast<int>(
+                std::chrono::ceil<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now())
+                    .count()));
+        if (left < 0)
+            ret = 1;
+        std::fflush(stdout);
+    }
+    coordinator.shutdown();
+    if (history && history->flush() < 0)
+        ret = 1;
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+    return ret;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options opts;
+    if (!parse_args(argc, argv, opts)) {
+        usage();
+        return 2;
+    }
+    if (!opts.decode_log.empty())
+        return decode_log(opts.decode_log);
+    if (!opts.binary_log.empty() &&
+        util::log::open_binary(opts.binary_log) < 0) {
+        std::fprintf(stderr, "cannot open %s\n", opts.binary_log.c_str());
+        return 1;
+    }
+    for (auto &[engine, n] : opts.log_samples)
+        util::log::set_sample_rate(js::engine_log_id(engine), n);
+    js::register_builtin_modules();
+
+    int ret;
+    if (!opts.coordinator.empty())
+        ret = run_coordinator(opts);
+    else if (!opts.shard.empty())
+        ret = run_shard(opts);
+    else
+        ret = run_scripts(opts);
+    util::log::flush();
+    return ret;
+}
@@ -0,0 +1,510 @@
+#include "history.hpp"
+#include "util/log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char segment_magic[8] = {'S', 'X', 'P', 'P', 'H', 'I', 'S', '1'};
+constexpr size_t segment_header_size = 16;
+constexpr size_t record_header_size = 16;
+
+struct RecordHeader {
+    uint32_t size;
+    uint16_t type;
+    uint16_t padding;
+    uint64_t timestamp;
+};
+static_assert(sizeof(RecordHeader) == record_header_size);
+
+struct IndexEntry {
+    uint64_t timestamp;
+    uint64_t offset;
+};
+
+struct QueryFixed {
+    uint64_t query_id;
+};
+
+struct LatencyFixed {
+    uint64_t query_id;
+    uint32_t engine;
+    uint32_t latency_us;
+    int32_t status;
+};
+
+struct ResultFixed {
+    uint64_t query_id;
+    uint32_t engine;
+    uint32_t position;
+    uint64_t fingerprint;
+};
+
+constexpr size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+std::string segment_name(uint64_t seq, const char *ext) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%016llx.%s",
+                  static_cast<unsigned long long>(seq), ext);
+    return buf;
+}
+
+bool parse_segment_name(const std::filesystem::path &path, uint64_t &seq) {
+    if (path.extension() != ".seg")
+        return false;
+    auto stem = path.stem().string();
+    char *end;
+    seq = std::strtoull(stem.c_str(), &end, 16);
+    return !stem.empty() && *end == '\0';
+}
+
+std::vector<uint64_t> list_segments(const std::filesystem::path &dir) {
+    std::vector<uint64_t> ret;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+        uint64_t seq;
+        if (parse_segment_name(entry.path(), seq))
+            ret.push_back(seq);
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+int write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Timestamp of the last intact record of segment `seq`, or its first
+// timestamp if it holds none. Scans from the last index entry.
+uint64_t last_timestamp(const std::filesystem::path &dir, uint64_t seq) {
+    uint64_t last = 0;
+    int fd = ::open((dir / segment_name(seq, "seg")).c_str(),
+                    O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return last;
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) >= segment_header_size)
+        data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return last;
+    auto seg = static_cast<const char *>(data);
+    size_t size = st.st_size;
+    if (std::memcmp(seg, segment_magic, sizeof(segment_magic)) == 0) {
+        std::memcpy(&last, seg + sizeof(segment_magic), sizeof(last));
+
+        uint64_t pos = segment_header_size;
+        std::ifstream idx(dir / segment_name(seq, "idx"), std::ios::binary);
+        IndexEntry entry;
+        while (idx.read(reinterpret_cast<char *>(&entry), sizeof(entry))) {
+            if (entry.offset < size)
+                pos = std::max(pos, entry.offset);
+        }
+        while (pos + record_header_size <= size) {
+            RecordHeader header;
+            std::memcpy(&header, seg + pos, sizeof(header));
+            if (header.size < record_header_size + header.padding ||
+                header.size > size - pos)
+                break;
+            last = std::max(last, header.timestamp);
+            pos += header.size;
+        }
+    }
+    ::munmap(data, size);
+    return last;
+}
+
+template <typename Fixed>
+bool read_fixed(std::string_view payload, Fixed &out) {
+    if (payload.size() < sizeof(Fixed))
+        return false;
+    std::memcpy(&out, payload.data(), sizeof(Fixed));
+    return true;
+}
+
+} // namespace
+
+namespace lany {
+namespace store {
+
+bool Record::get(QueryRecord &out) const {
+    QueryFixed fixed;
+    if (type != RecordType::query || !read_fixed(payload, fixed))
+        return false;
+    out.query_id = fixed.query_id;
+    out.text = payload.substr(sizeof(QueryFixed));
+    return true;
+}
+
+bool Record::get(LatencyRecord &out) const {
+    LatencyFixed fixed;
+    if (type != RecordType::latency || !read_fixed(payload, fixed))
+        return false;
+    out = {fixed.query_id, fixed.engine, fixed.latency_us, fixed.status};
+    return true;
+}
+
+bool Record::get(ResultRecord &out) const {
+    ResultFixed fixed;
+    if (type != RecordType::result || !read_fixed(payload, fixed))
+        return false;
+    out = {fixed.query_id, fixed.engine, fixed.position, fixed.fingerprint};
+    return true;
+}
+
+uint64_t fingerprint(std::string_view str) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : str) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+HistoryWriter::HistoryWriter(const std::filesystem::path &dir)
+    : HistoryWriter(dir, Options{}) {}
+
+HistoryWriter::HistoryWriter(const std::filesystem::path &dir,
+                             const Options &opts)
+    : dir(dir), opts(opts) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec)
+        LANY_LOG_ERROR("history: could not create {}: {}", dir.string(),
+                       ec.message());
+    auto segments = list_segments(dir);
+    seg_seq = segments.empty() ? 0 : segments.back() + 1;
+    // timestamps must keep increasing across restarts, even if the clock
+    // went back
+    if (!segments.empty())
+        last_ts = last_timestamp(dir, segments.back());
+    thread = std::thread(&HistoryWriter::run, this);
+}
+
+HistoryWriter::~HistoryWriter() {
+    {
+        std::lock_guard lock(mtx);
+        stopping = true;
+    }
+    cv.notify_one();
+    thread.join();
+    close_segment();
+}
+
+void HistoryWriter::append(RecordType type, const void *fixed,
+                           size_t fixed_size, std::string_view tail) {
+    size_t payload = fixed_size + tail.size();
+    size_t size = align8(record_header_size + payload);
+    bool notify;
+    {
+        std::lock_guard lock(mtx);
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+        last_ts = std::max<uint64_t>(last_ts + 1, now);
+        RecordHeader header{static_cast<uint32_t>(size),
+                            static_cast<uint16_t>(type),
+                            static_cast<uint16_t>(size - record_header_size -
+                                                  payload),
+                            last_ts};
+
+        size_t pos = front.size();
+        front.resize(pos + size);
+        char *out = front.data() + pos;
+        std::memcpy(out, &header, sizeof(header));
+        std::memcpy(out + record_header_size, fixed, fixed_size);
+        if (!tail.empty())
+            std::memcpy(out + record_header_size + fixed_size, tail.data(),
+                        tail.size());
+        std::memset(out + record_header_size + payload, 0,
+                    size - record_header_size - payload);
+        appended += size;
+        notify = front.size() >= opts.batch_size;
+    }
+    if (notify)
+        cv.notify_one();
+}
+
+void HistoryWriter::log_query(uint64_t query_id, std::string_view text) {
+    QueryFixed fixed{query_id};
+    append(RecordType::query, &fixed, sizeof(fixed), text);
+}
+
+void HistoryWriter::log_latency(uint64_t query_id, uint32_t engine,
+                                uint32_t latency_us, int32_t status) {
+    LatencyFixed fixed{query_id, engine, latency_us, status};
+    append(RecordType::latency, &fixed, sizeof(fixed));
+}
+
+void HistoryWriter::log_result(uint64_t query_id, uint32_t engine,
+                               uint32_t position, uint64_t fingerprint) {
+    ResultFixed fixed{query_id, engine, position, fingerprint};
+    append(RecordType::result, &fixed, sizeof(fixed));
+}
+
+int HistoryWriter::flush() {
+    std::unique_lock lock(mtx);
+    uint64_t target = appended;
+    uint64_t failed = failures;
+    flush_requested = true;
+    cv.notify_one();
+    flushed.wait(lock, [&] {
+        return written >= target || failures != failed || stopping;
+    });
+    return written >= target ? 0 : -1;
+}
+
+void HistoryWriter::run() {
+    std::vector<char> batch;
+    bool retrying = false;
+    while (true) {
+        {
+            std::unique_lock lock(mtx);
+            // after a failure, wait out the interval before trying again
+            cv.wait_for(lock, opts.flush_interval, [&] {
+                return stopping ||
+                       (!retrying && (flush_requested ||
+                                      front.size() >= opts.batch_size));
+            });
+            flush_requested = false;
+            if (front.empty() || (stopping && retrying)) {
+                if (stopping) {
+                    if (!front.empty())
+                        LANY_LOG_ERROR("history: dropping {} unwritten bytes",
+                                       front.size());
+                    return;
+                }
+                continue;
+            }
+            batch.swap(front);
+        }
+        size_t done;
+        retrying = write_batch(batch, done) < 0;
+        {
+            std::lock_guard lock(mtx);
+            written += done;
+            if (retrying) {
+                // the rest goes back in front of anything appended since
+                failures++;
+                batch.erase(batch.begin(), batch.begin() + done);
+                batch.insert(batch.end(), front.begin(), front.end());
+                front.swap(batch);
+            }
+        }
+        flushed.notify_all();
+        batch.clear();
+    }
+}
+
+int HistoryWriter::open_segment(uint64_t first_ts) {
+    close_segment();
+    auto seg_path = dir / segment_name(seg_seq, "seg");
+    auto idx_path = dir / segment_name(seg_seq, "idx");
+    seg_fd = ::open(seg_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    idx_fd = ::open(idx_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (seg_fd < 0 || idx_fd < 0) {
+        LANY_LOG_ERROR("history: could not open segment {}",
+                       seg_path.string());
+        close_segment();
+        return -1;
+    }
+    char header[segment_header_size];
+    std::memcpy(header, segment_magic, sizeof(segment_magic));
+    std::memcpy(header + sizeof(segment_magic), &first_ts, sizeof(first_ts));
+    if (write_all(seg_fd, header, sizeof(header)) < 0) {
+        close_segment();
+        return -1;
+    }
+    seg_seq++;
+    seg_size = segment_header_size;
+    idx_size = 0;
+    next_index = seg_size;
+    return 0;
+}
+
+void HistoryWriter::close_segment() {
+    if (seg_fd >= 0)
+        ::close(seg_fd);
+    if (idx_fd >= 0)
+        ::close(idx_fd);
+    seg_fd = idx_fd = -1;
+}
+
+// Writes whole records, rolling segments and emitting index entries on the
+// way, then syncs once per batch. Sets `done` to the bytes of `batch` that
+// are durably stored; on failure everything after them is cut from the
+// segment again so a retry does not duplicate records.
+int HistoryWriter::write_batch(const std::vector<char> &batch, size_t &done) {
+    std::vector<IndexEntry> index;
+    size_t pos = 0, range = 0;
+    // sizes of the open segment and its index at `done`
+    uint64_t seg_mark = seg_size, idx_mark = idx_size;
+    done = 0;
+
+    auto write_range = [&](size_t end) {
+        if (end > range &&
+            write_all(seg_fd, batch.data() + range, end - range) < 0)
+            return -1;
+        size_t idx_bytes = index.size() * sizeof(IndexEntry);
+        if (idx_bytes > 0 &&
+            write_all(idx_fd, reinterpret_cast<const char *>(index.data()),
+                      idx_bytes) < 0)
+            return -1;
+        idx_size += idx_bytes;
+        index.clear();
+        range = end;
+        return 0;
+    };
+    auto sync = [&] {
+        return ::fdatasync(seg_fd) < 0 || ::fdatasync(idx_fd) < 0 ? -1 : 0;
+    };
+    auto fail = [&] {
+        LANY_LOG_ERROR("history: write failed: {}", std::strerror(errno));
+        if (seg_fd >= 0) {
+            if (::ftruncate(seg_fd, seg_mark) < 0 ||
+                ::ftruncate(idx_fd, idx_mark) < 0)
+                LANY_LOG_ERROR("history: could not roll back segment");
+        }
+        // the next attempt starts a fresh segment
+        close_segment();
+        return -1;
+    };
+
+    while (pos + record_header_size <= batch.size()) {
+        RecordHeader header;
+        std::memcpy(&header, batch.data() + pos, sizeof(header));
+        if (seg_fd < 0 || seg_size + header.size > opts.segment_size) {
+            if (seg_fd >= 0) {
+                if (write_range(pos) < 0 || sync() < 0)
+                    return fail();
+                done = pos;
+            }
+            if (open_segment(header.timestamp) < 0)
+                return fail();
+            seg_mark = seg_size;
+            idx_mark = idx_size;
+        }
+        if (seg_size >= next_index) {
+            index.push_back({header.timestamp, seg_size});
+            next_index = seg_size + opts.index_interval;
+        }
+        seg_size += header.size;
+        pos += header.size;
+    }
+    if (seg_fd >= 0 && (write_range(pos) < 0 || sync() < 0))
+        return fail();
+    done = pos;
+    return 0;
+}
+
+HistoryReader::HistoryReader(const std::filesystem::path &dir) {
+    for (auto seq : list_segments(dir)) {
+        auto seg_path = dir / segment_name(seq, "seg");
+        int fd = ::open(seg_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        struct stat st;
+        if (::fstat(fd, &st) < 0 ||
+            static_cast<size_t>(st.st_size) < segment_header_size) {
+            ::close(fd);
+            continue;
+        }
+        void *data =
+            ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            continue;
+        if (std::memcmp(data, segment_magic, sizeof(segment_magic)) != 0) {
+            ::munmap(data, st.st_size);
+            continue;
+        }
+        ::madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+        Segment seg;
+        seg.seq = seq;
+        seg.data = static_cast<const char *>(data);
+        seg.size = st.st_size;
+        std::memcpy(&seg.first_ts, seg.data + sizeof(segment_magic),
+                    sizeof(seg.first_ts));
+
+        std::ifstream idx(dir / segment_name(seq, "idx"), std::ios::binary);
+        IndexEntry entry;
+        while (idx.read(reinterpret_cast<char *>(&entry), sizeof(entry))) {
+            if (entry.offset < seg.size)
+                seg.index.emplace_back(entry.timestamp, entry.offset);
+        }
+        segments.emplace_back(std::move(seg));
+    }
+}
+
+HistoryReader::~HistoryReader() {
+    for (auto &seg : segments)
+        ::munmap(const_cast<char *>(seg.data), seg.size);
+}
+
+size_t HistoryReader::segment_count() const { return segments.size(); }
+
+void HistoryReader::scan(
+    uint64_t from, uint64_t to,
+    const std::function<bool(const Record &)> &visit) const {
+    for (size_t i = 0; i < segments.size(); i++) {
+        const auto &seg = segments[i];
+        if (seg.first_ts >= to)
+            return;
+        if (i + 1 < segments.size() && segments[i + 1].first_ts < from)
+            continue;
+
+        uint64_t pos = segment_header_size;
+        auto it = std::lower_bound(
+            seg.index.begin(), seg.index.end(), from,
+            [](const auto &entry, uint64_t ts) { return entry.first < ts; });
+        if (it != seg.index.begin())
+            pos = std::prev(it)->second;
+
+        while (pos + record_header_size <= seg.size) {
+            RecordHeader header;
+            std::memcpy(&header, seg.data + pos, sizeof(header));
+            if (header.size < record_header_size + header.padding ||
+                header.size > seg.size - pos)
+                break;
+            if (header.timestamp >= to)
+                return;
+            if (header.timestamp >= from) {
+                Record record{static_cast<RecordType>(header.type),
+                              header.timestamp,
+                              {seg.data + pos + record_header_size,
+                               header.size - record_header_size -
+                                   header.padding}};
+                if (!visit(record))
+                    return;
+            }
+            pos += header.size;
+        }
+    }
+}
+
+} // namespace store
+} // namespace lany
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace lany {
+namespace store {
+
+// Append-only query history.
+//
+// Records are written to numbered segment files (`<seq>.seg`) next to a
+// sparse time index (`<seq>.idx`) holding one (timestamp, offset) pair every
+// `index_interval` bytes. Timestamps never decrease, so a reader can binary
+// search the index and scan the mmapped segment sequentially from there.
+//
+// Segment layout: a 16 byte header ("SXPPHIS1", first timestamp) followed by
+// 8 byte aligned records of
+//   uint32 size | uint16 type | uint16 padding | uint64 timestamp | payload
+// A truncated tail left by a crash ends the scan of that segment.
+
+enum class RecordType : uint16_t {
+    query = 1,
+    latency = 2,
+    result = 3,
+};
+
+struct QueryRecord {
+    uint64_t query_id;
+    std::string_view text;
+};
+
+struct LatencyRecord {
+    uint64_t query_id;
+    uint32_t engine;
+    uint32_t latency_us;
+    int32_t status;
+};
+
+struct ResultRecord {
+    uint64_t query_id;
+    uint32_t engine;
+    uint32_t position;
+    uint64_t fingerprint;
+};
+
+struct Record {
+    RecordType type;
+    uint64_t timestamp;
+    std::string_view payload;
+
+    bool get(QueryRecord &out) const;
+    bool get(LatencyRecord &out) const;
+    bool get(ResultRecord &out) const;
+};
+
+uint64_t fingerprint(std::string_view str);
+
+class HistoryWriter {
+public:
+    struct Options {
+        uint64_t segment_size = 64 << 20;
+        uint32_t index_interval = 64 << 10;
+        size_t batch_size = 1 << 20;
+        std::chrono::milliseconds flush_interval{200};
+    };
+
+private:
+    std::filesystem::path dir;
+    Options opts;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::condition_variable flushed;
+    std::vector<char> front;
+    uint64_t last_ts = 0;
+    uint64_t appended = 0;
+    uint64_t written = 0;
+    uint64_t failures = 0;
+    bool flush_requested = false;
+    bool stopping = false;
+    std::thread thread;
+
+    // segment state, owned by the writer thread
+    int seg_fd = -1;
+    int idx_fd = -1;
+    uint64_t seg_seq = 0;
+    uint64_t seg_size = 0;
+    uint64_t idx_size = 0;
+    uint64_t next_index = 0;
+
+    void append(RecordType type, const void *fixed, size_t fixed_size,
+                std::string_view tail = {});
+    void run();
+    int write_batch(const std::vector<char> &batch, size_t &done);
+    int open_segment(uint64_t first_ts);
+    void close_segment();
+
+public:
+    HistoryWriter(const std::filesystem::path &dir);
+    HistoryWriter(const std::filesystem::path &dir, const Options &opts);
+    HistoryWriter(const HistoryWriter &) = delete;
+    HistoryWriter &operator=(const HistoryWriter &) = delete;
+    ~HistoryWriter();
+
+    void log_query(uint64_t query_id, std::string_view text);
+    void log_latency(uint64_t query_id, uint32_t engine, uint32_t latency_us,
+                     int32_t status);
+    void log_result(uint64_t query_id, uint32_t engine, uint32_t position,
+                    uint64_t fingerprint);
+    // Waits until everything appended so far is on disk. Returns -1 if a
+    // write failed; the records stay queued and are retried.
+    int flush();
+};
+
+class HistoryReader {
+    struct Segment {
+        uint64_t seq;
+        uint64_t first_ts;
+        const char *data = nullptr;
+        size_t size = 0;
+        std::vector<std::pair<uint64_t, uint64_t>> index;
+    };
+
+    std::vector<Segment> segments;
+
+public:
+    HistoryReader(const std::filesystem::path &dir);
+    HistoryReader(const HistoryReader &) = delete;
+    HistoryReader &operator=(const HistoryReader &) = delete;
+    ~HistoryReader();
+
+    size_t segment_count() const;
+    // Calls `visit` for every record with from <= timestamp < to, in order.
+    // Stops early when `visit` returns false.
+    void scan(uint64_t from, uint64_t to,
+              const std::function<bool(const Record &)> &visit) const;
+};
+
+} // namespace store
+} // namespace lany
@@ -0,0 +1,100 @@
+#include "buffer_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace lany {
+namespace util {
+
+buffer_pool::~buffer_pool() {
+    for (auto &list : free_list) {
+        for (auto data : list)
+            delete[] data;
+    }
+}
+
+buffer_pool &buffer_pool::global() {
+    static buffer_pool pool;
+    return pool;
+}
+
+size_t buffer_pool::round_up(size_t size) {
+    if (size <= (size_t(1) << min_shift))
+        return size_t(1) << min_shift;
+    if (size > (size_t(1) << max_shift))
+        return size;
+    return std::bit_ceil(size);
+}
+
+uint8_t *buffer_pool::acquire(size_t &capacity) {
+    capacity = round_up(capacity);
+    if (capacity <= (size_t(1) << max_shift)) {
+        size_t cls = std::countr_zero(capacity) - min_shift;
+        std::lock_guard lock(mtx);
+        auto &list = free_list[cls];
+        if (!list.empty()) {
+            uint8_t *data = list.back();
+            list.pop_back();
+            return data;
+        }
+    }
+    return new uint8_t[capacity];
+}
+
+void buffer_pool::release(uint8_t *data, size_t capacity) noexcept {
+    if (!data)
+        return;
+    if (capacity >= (size_t(1) << min_shift) &&
+        capacity <= (size_t(1) << max_shift) && std::has_single_bit(capacity)) {
+        size_t cls = std::countr_zero(capacity) - min_shift;
+        std::lock_guard lock(mtx);
+        auto &list = free_list[cls];
+        if (list.size() < max_free) {
+            list.push_back(data);
+            return;
+        }
+    }
+    delete[] data;
+}
+
+pooled_buffer::pooled_buffer(buffer_pool &pool) : pool(&pool) {}
+
+pooled_buffer::pooled_buffer(pooled_buffer &&other)
+    : pool(other.pool), _data(other._data), _size(other._size),
+      _capacity(other._capacity) {
+    other._data = nullptr;
+    other._size = other._capacity = 0;
+}
+
+pooled_buffer::~pooled_buffer() { pool->release(_data, _capacity); }
+
+void pooled_buffer::reserve_extra(size_t extra) {
+    if (spare() >= extra)
+        return;
+    size_t capacity = std::max(_size + extra, _capacity * 2);
+    uint8_t *data = pool->acquire(capacity);
+    if (_size)
+        std::memcpy(data, _data, _size);
+    pool->release(_data, _capacity);
+    _data = data;
+    _capacity = capacity;
+}
+
+void pooled_buffer::append(const uint8_t *src, size_t n) {
+    reserve_extra(n);
+    std::memcpy(tail(), src, n);
+    commit(n);
+}
+
+uint8_t *pooled_buffer::release(size_t &size, size_t &capacity) {
+    uint8_t *data = _data;
+    size = _size;
+    capacity = _capacity;
+    _data = nullptr;
+    _size = _capacity = 0;
+    return data;
+}
+
+} // namespace util
+} // namespace lany
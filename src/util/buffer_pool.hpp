@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace lany {
+
+namespace util {
+
+// Recycles power-of-two sized blocks so that short-lived byte buffers (for
+// example decoded response bodies) do not hit the allocator on every
+// request. Blocks above the largest class are allocated directly.
+class buffer_pool {
+    static constexpr size_t min_shift = 12;
+    static constexpr size_t max_shift = 24;
+    static constexpr size_t max_free = 32;
+
+    std::mutex mtx;
+    std::array<std::vector<uint8_t *>, max_shift - min_shift + 1> free_list;
+
+public:
+    buffer_pool() = default;
+    buffer_pool(const buffer_pool &) = delete;
+    buffer_pool &operator=(const buffer_pool &) = delete;
+    ~buffer_pool();
+
+    static buffer_pool &global();
+    static size_t round_up(size_t size);
+
+    // Returns a block of at least `capacity` bytes and updates `capacity`
+    // to the real block size.
+    uint8_t *acquire(size_t &capacity);
+    void release(uint8_t *data, size_t capacity) noexcept;
+};
+
+class pooled_buffer {
+    buffer_pool *pool;
+    uint8_t *_data = nullptr;
+    size_t _size = 0;
+    size_t _capacity = 0;
+
+public:
+    pooled_buffer(buffer_pool &pool = buffer_pool::global());
+    pooled_buffer(const pooled_buffer &) = delete;
+    pooled_buffer(pooled_buffer &&other);
+    pooled_buffer &operator=(const pooled_buffer &) = delete;
+    ~pooled_buffer();
+
+    uint8_t *data() { return _data; }
+    size_t size() const { return _size; }
+    size_t capacity() const { return _capacity; }
+    uint8_t *tail() { return _data + _size; }
+    size_t spare() const { return _capacity - _size; }
+
+    // Makes room for at least `extra` more bytes, keeping the contents.
+    void reserve_extra(size_t extra);
+    void commit(size_t n) { _size += n; }
+    void append(const uint8_t *src, size_t n);
+    // Hands the block over to the caller, who returns it to the pool with
+    // buffer_pool::release(data, capacity).
+    uint8_t *release(size_t &size, size_t &capacity);
+};
+
+} // namespace util
+
+} // namespace lany
@@ -0,0 +1,199 @@
+#include "decoder.hpp"
+
+#include <algorithm>
+
+#include <brotli/decode.h>
+#include <zlib.h>
+#include <zstd.h>
+
+namespace {
+
+using namespace lany::util;
+
+constexpr size_t min_chunk = 16 << 10;
+
+class identity_decoder : public decoder {
+public:
+    int update(const uint8_t *in, size_t len, pooled_buffer &out) override {
+        out.append(in, len);
+        return 0;
+    }
+    bool finished() const override { return false; }
+};
+
+// gzip and zlib streams, with a fallback to raw deflate for servers that
+// send "deflate" without the zlib wrapper. gzip bodies may hold several
+// members, which decode to their concatenation.
+class zlib_decoder : public decoder {
+    z_stream zs{};
+    bool gzip;
+    // "deflate" only: the first two bytes, held back until it is known
+    // whether they are a zlib header
+    uint8_t header[2];
+    size_t header_len = 0;
+    bool sniffing;
+    bool done = false;
+
+    static bool is_zlib_header(const uint8_t *p) {
+        return (p[0] & 0x0f) == Z_DEFLATED && (p[0] >> 4) <= 7 &&
+               ((p[0] << 8) | p[1]) % 31 == 0;
+    }
+
+    int inflate_chunk(const uint8_t *in, size_t len, pooled_buffer &out) {
+        zs.next_in = const_cast<Bytef *>(in);
+        zs.avail_in = static_cast<uInt>(len);
+        while (true) {
+            if (done) {
+                // only another gzip member may follow the end of a stream
+                if (!gzip || zs.avail_in == 0)
+                    break;
+                inflateReset(&zs);
+                done = false;
+            }
+            out.reserve_extra(std::max(min_chunk, size_t(zs.avail_in) * 4));
+            zs.next_out = out.tail();
+            zs.avail_out = static_cast<uInt>(out.spare());
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            out.commit(out.spare() - zs.avail_out);
+            if (ret == Z_STREAM_END) {
+                done = true;
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                _error = zs.msg ? zs.msg : "inflate failed";
+                return -1;
+            } else if (zs.avail_out != 0) {
+                // all input consumed and no output held back
+                break;
+            }
+        }
+        return 0;
+    }
+
+public:
+    zlib_decoder(bool gzip) : gzip(gzip), sniffing(!gzip) {
+        inflateInit2(&zs, gzip ? 15 + 16 : 15);
+    }
+    ~zlib_decoder() override { inflateEnd(&zs); }
+
+    int update(const uint8_t *in, size_t len, pooled_buffer &out) override {
+        if (sniffing) {
+            while (header_len < 2 && len > 0) {
+                header[header_len++] = *in++;
+                len--;
+            }
+            if (header_len < 2)
+                return 0;
+            sniffing = false;
+            if (!is_zlib_header(header))
+                inflateReset2(&zs, -15);
+            if (inflate_chunk(header, header_len, out) < 0)
+                return -1;
+        }
+        return inflate_chunk(in, len, out);
+    }
+    bool finished() const override { return done; }
+};
+
+class brotli_decoder : public decoder {
+    BrotliDecoderState *state;
+    bool done = false;
+
+public:
+    brotli_decoder()
+        : state(BrotliDecoderCreateInstance(nullptr, nullptr, nullptr)) {}
+    ~brotli_decoder() override { BrotliDecoderDestroyInstance(state); }
+
+    int update(const uint8_t *in, size_t len, pooled_buffer &out) override {
+        size_t avail_in = len;
+        const uint8_t *next_in = in;
+        while (!done) {
+            out.reserve_extra(std::max(min_chunk, avail_in * 4));
+            size_t avail_out = out.spare();
+            uint8_t *next_out = out.tail();
+            auto ret = BrotliDecoderDecompressStream(
+                state, &avail_in, &next_in, &avail_out, &next_out, nullptr);
+            out.commit(out.spare() - avail_out);
+            if (ret == BROTLI_DECODER_RESULT_SUCCESS) {
+                done = true;
+            } else if (ret == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+                break;
+            } else if (ret == BROTLI_DECODER_RESULT_ERROR) {
+                _error = BrotliDecoderErrorString(
+                    BrotliDecoderGetErrorCode(state));
+                return -1;
+            }
+        }
+        return 0;
+    }
+    bool finished() const override { return done; }
+};
+
+class zstd_decoder : public decoder {
+    ZSTD_DStream *stream;
+    bool done = false;
+
+public:
+    zstd_decoder() : stream(ZSTD_createDStream()) { ZSTD_initDStream(stream); }
+    ~zstd_decoder() override { ZSTD_freeDStream(stream); }
+
+    int update(const uint8_t *in, size_t len, pooled_buffer &out) override {
+        ZSTD_inBuffer input{in, len, 0};
+        while (input.pos < input.size || !done) {
+            out.reserve_extra(std::max(min_chunk, ZSTD_DStreamOutSize()));
+            ZSTD_outBuffer output{out.tail(), out.spare(), 0};
+            size_t ret = ZSTD_decompressStream(stream, &output, &input);
+            out.commit(output.pos);
+            if (ZSTD_isError(ret)) {
+                _error = ZSTD_getErrorName(ret);
+                return -1;
+            }
+            // a frame ended; more frames may follow in the same body
+            done = ret == 0;
+            if (input.pos == input.size && output.pos < output.size)
+                break;
+        }
+        return 0;
+    }
+    bool finished() const override { return done; }
+};
+
+} // namespace
+
+namespace lany {
+namespace util {
+
+const char accept_encoding[] = "zstd, br, gzip, deflate";
+
+bool parse_encoding(std::string_view name, encoding &out) {
+    if (name.empty() || name == "identity")
+        out = encoding::identity;
+    else if (name == "gzip" || name == "x-gzip")
+        out = encoding::gzip;
+    else if (name == "deflate")
+        out = encoding::deflate;
+    else if (name == "br")
+        out = encoding::br;
+    else if (name == "zstd")
+        out = encoding::zstd;
+    else
+        return false;
+    return true;
+}
+
+std::unique_ptr<decoder> decoder::create(encoding enc) {
+    switch (enc) {
+    case encoding::identity:
+        return std::make_unique<identity_decoder>();
+    case encoding::gzip:
+        return std::make_unique<zlib_decoder>(true);
+    case encoding::deflate:
+        return std::make_unique<zlib_decoder>(false);
+    case encoding::br:
+        return std::make_unique<brotli_decoder>();
+    case encoding::zstd:
+        return std::make_unique<zstd_decoder>();
+    }
+    return nullptr;
+}
+
+} // namespace util
+} // namespace lany
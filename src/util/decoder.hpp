@@ -0,0 +1,44 @@
+#pragma once
+
+#include "buffer_pool.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace lany {
+
+namespace util {
+
+enum class encoding { identity, gzip, deflate, br, zstd };
+
+// Value for the Accept-Encoding request header listing every encoding a
+// decoder can be created for.
+extern const char accept_encoding[];
+
+bool parse_encoding(std::string_view name, encoding &out);
+
+// Streaming decoder for a Content-Encoding. Input may be fed in arbitrary
+// chunks as it arrives from the network.
+class decoder {
+protected:
+    std::string _error;
+
+public:
+    virtual ~decoder() = default;
+
+    static std::unique_ptr<decoder> create(encoding enc);
+
+    // Decodes `len` bytes, appending the output to `out`. Returns -1 on
+    // corrupt input, see error().
+    virtual int update(const uint8_t *in, size_t len, pooled_buffer &out) = 0;
+    // True once the end of the compressed stream has been seen.
+    virtual bool finished() const = 0;
+
+    const std::string &error() const { return _error; }
+};
+
+} // namespace util
+
+} // namespace lany
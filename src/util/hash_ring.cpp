@@ -0,0 +1,57 @@
+#include "hash_ring.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace lany {
+namespace util {
+
+uint64_t hash64(std::string_view str) {
+    // FNV-1a followed by the splitmix64 finalizer for better avalanche on
+    // short keys
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : str) {
+        h ^= c;
+        h *= 0x100000001b3ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+hash_ring::hash_ring(uint32_t replicas) : replicas(replicas) {}
+
+void hash_ring::add(uint32_t node) {
+    for (uint32_t i = 0; i < replicas; i++) {
+        auto key = std::to_string(node) + "#" + std::to_string(i);
+        points.emplace_back(hash64(key), node);
+    }
+    std::sort(points.begin(), points.end());
+}
+
+void hash_ring::remove(uint32_t node) {
+    std::erase_if(points, [&](const auto &p) { return p.second == node; });
+}
+
+bool hash_ring::empty() const { return points.empty(); }
+
+int64_t hash_ring::lookup(std::string_view key,
+                          const std::function<bool(uint32_t)> &accept) const {
+    if (points.empty())
+        return -1;
+    auto start = std::lower_bound(points.begin(), points.end(),
+                                  std::make_pair(hash64(key), uint32_t(0)));
+    size_t begin = start - points.begin();
+    for (size_t n = 0; n < points.size(); n++) {
+        uint32_t node = points[(begin + n) % points.size()].second;
+        if (!accept || accept(node))
+            return node;
+    }
+    return -1;
+}
+
+} // namespace util
+} // namespace lany
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace lany {
+
+namespace util {
+
+uint64_t hash64(std::string_view str);
+
+// Consistent hash ring. Every node owns `replicas` points on the ring, so
+// adding or removing a node only moves the keys adjacent to its points.
+class hash_ring {
+    std::vector<std::pair<uint64_t, uint32_t>> points;
+    uint32_t replicas;
+
+public:
+    hash_ring(uint32_t replicas = 64);
+
+    void add(uint32_t node);
+    void remove(uint32_t node);
+    bool empty() const;
+
+    // First node clockwise from `key` that satisfies `accept`, or -1.
+    int64_t lookup(std::string_view key,
+                   const std::function<bool(uint32_t)> &accept = {}) const;
+};
+
+} // namespace util
+
+} // namespace lany
@@ -0,0 +1,654 @@
+#include "http_client.hpp"
+#include "decoder.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+namespace {
+
+using namespace lany::util;
+
+constexpr size_t resolver_threads = 4;
+
+// What is known about a response so far, so each readable event only looks
+// at the bytes it added.
+struct response_parser {
+    http_response res;
+    // bytes already searched for the end of the head
+    size_t scanned = 0;
+    // start of the body once the head is parsed, 0 before
+    size_t body = 0;
+    bool chunked = false;
+    size_t length = std::string::npos;
+    // start of the next chunk header
+    size_t chunk = 0;
+};
+
+struct connection {
+    int fd = -1;
+    SSL *ssl = nullptr;
+    bool connected = false;
+    bool handshaken = false;
+    // what the connection waits for next
+    short events = POLLOUT;
+    std::string out;
+    size_t written = 0;
+    std::string in;
+    response_parser parser;
+    http_client::clock::time_point deadline;
+    http_client::callback done;
+};
+
+http_response failure(std::string error) {
+    http_response res;
+    res.error = std::move(error);
+    return res;
+}
+
+// Appends the chunks following `pos` to `body`, leaving `pos` at the first
+// incomplete one. Returns 1 once the last chunk is read, 0 if more input is
+// needed and -1 if it is malformed.
+int decode_chunked(std::string_view in, size_t &pos, std::string &body) {
+    while (true) {
+        size_t eol = in.find("\r\n", pos);
+        if (eol == std::string_view::npos)
+            return 0;
+        // chunk size in hex, optionally followed by extensions
+        char *size_end;
+        size_t size = std::strtoul(in.data() + pos, &size_end, 16);
+        if (size_end == in.data() + pos)
+            return -1;
+        if (size == 0)
+            return 1;
+        size_t data = eol + 2;
+        if (in.size() < data + size + 2)
+            return 0;
+        body.append(in.substr(data, size));
+        pos = data + size + 2;
+    }
+}
+
+// Fills in the status and headers from the head ending at `end`. Returns
+// false if it is not an HTTP/1 response.
+bool parse_head(std::string_view in, size_t end, response_parser &p) {
+    auto &res = p.res;
+    if (in.compare(0, 7, "HTTP/1.") != 0 || in.size() < 12) {
+        res.error = "malformed response";
+        return false;
+    }
+    res.status = std::atoi(in.data() + 9);
+    size_t pos = in.find("\r\n") + 2;
+    while (pos < end) {
+        size_t eol = in.find("\r\n", pos);
+        auto line = in.substr(pos, eol - pos);
+        pos = eol + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos)
+            continue;
+        auto name = line.substr(0, colon);
+        auto value = line.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ')
+            value.remove_prefix(1);
+        std::string lower(name);
+        for (auto &c : lower)
+            c = std::tolower(static_cast<unsigned char>(c));
+        res.headers.emplace_back(std::move(lower), value);
+        if (res.headers.back().first == "content-length")
+            p.length = std::strtoull(std::string(value).c_str(), nullptr, 10);
+        else if (res.headers.back().first == "transfer-encoding" &&
+                 value.find("chunked") != std::string_view::npos)
+            p.chunked = true;
+    }
+    p.body = p.chunk = end + 4;
+    return true;
+}
+
+// Returns true once `in` holds a complete response (or `eof` cut it short,
+// which is reported through p.res.error). Picks up where the previous call
+// left off.
+bool parse_response(std::string_view in, bool eof, response_parser &p) {
+    auto &res = p.res;
+    if (!p.body) {
+        // the terminator may straddle the previous end of input
+        size_t from = p.scanned > 3 ? p.scanned - 3 : 0;
+        size_t end = in.find("\r\n\r\n", from);
+        if (end == std::string_view::npos) {
+            p.scanned = in.size();
+            if (eof)
+                res.error = "truncated response";
+            return eof;
+        }
+        if (!parse_head(in, end, p))
+            return true;
+    }
+
+    if (p.chunked) {
+        int ret = decode_chunked(in, p.chunk, res.body);
+        if (ret == 0 && !eof)
+            return false;
+        if (ret <= 0)
+            res.error = ret < 0 ? "malformed chunk" : "truncated response";
+        return true;
+    }
+    auto body = in.substr(p.body);
+    if (p.length != std::string::npos) {
+        if (body.size() < p.length) {
+            if (eof)
+                res.error = "truncated response";
+            return eof;
+        }
+        res.body.assign(body.substr(0, p.length));
+        return true;
+    }
+    if (eof)
+        res.body.assign(body);
+    return eof;
+}
+
+// Replaces the body with its decoded form if the response names a
+// Content-Encoding.
+void decode_body(http_response &res) {
+    auto it = std::find_if(
+        res.headers.begin(), res.headers.end(),
+        [](auto &h) { return h.first == "content-encoding"; });
+    if (it == res.headers.end() || res.body.empty())
+        return;
+    encoding enc;
+    if (!parse_encoding(it->second, enc)) {
+        res.error = "unsupported content-encoding " + it->second;
+        return;
+    }
+    if (enc == encoding::identity)
+        return;
+    auto dec = decoder::create(enc);
+    pooled_buffer out;
+    if (dec->update(reinterpret_cast<const uint8_t *>(res.body.data()),
+                    res.body.size(), out) < 0)
+        res.error = "could not decode body: " + dec->error();
+    else if (!dec->finished())
+        res.error = "truncated compressed body";
+    else
+        res.body.assign(reinterpret_cast<const char *>(out.data()),
+                        out.size());
+}
+
+std::string tls_error(SSL *ssl) {
+    long verify = SSL_get_verify_result(ssl);
+    if (verify != X509_V_OK)
+        return std::string("certificate: ") +
+               X509_verify_cert_error_string(verify);
+    unsigned long err = ERR_get_error();
+    ERR_clear_error();
+    if (err == 0)
+        return "tls failure";
+    char buf[256];
+    ERR_error_string_n(err, buf, sizeof(buf));
+    return buf;
+}
+
+int open_connection(const sockaddr_storage &addr, socklen_t len) {
+    int fd = ::socket(addr.ss_family,
+                      SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0 &&
+        ::connect(fd, reinterpret_cast<const sockaddr *>(&addr), len) < 0 &&
+        errno != EINPROGRESS) {
+        ::close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Sets up TLS on a connection to `host`, with SNI and host name checks.
+SSL *open_tls(SSL_CTX *ctx, int fd, const std::string &host) {
+    SSL *ssl = SSL_new(ctx);
+    if (!ssl)
+        return nullptr;
+    in6_addr ip;
+    bool literal = ::inet_pton(AF_INET, host.c_str(), &ip) == 1 ||
+                   ::inet_pton(AF_INET6, host.c_str(), &ip) == 1;
+    bool ok = SSL_set_fd(ssl, fd) == 1;
+    if (literal)
+        ok = ok && X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl),
+                                                 host.c_str()) == 1;
+    else
+        ok = ok && SSL_set_tlsext_host_name(ssl, host.c_str()) == 1 &&
+             SSL_set1_host(ssl, host.c_str()) == 1;
+    if (!ok) {
+        SSL_free(ssl);
+        return nullptr;
+    }
+    SSL_set_connect_state(ssl);
+    return ssl;
+}
+
+void finish(connection &conn, http_response res) {
+    if (conn.ssl)
+        SSL_free(conn.ssl);
+    conn.ssl = nullptr;
+    ::close(conn.fd);
+    conn.fd = -1;
+    conn.done(std::move(res));
+}
+
+// Maps the result of an SSL call to the events to wait for. Returns false
+// if the connection failed.
+bool tls_wait(connection &conn, int ret) {
+    switch (SSL_get_error(conn.ssl, ret)) {
+    case SSL_ERROR_WANT_READ:
+        conn.events = POLLIN;
+        return true;
+    case SSL_ERROR_WANT_WRITE:
+        conn.events = POLLOUT;
+        return true;
+    default:
+        finish(conn, failure(tls_error(conn.ssl)));
+        return false;
+    }
+}
+
+// Returns the bytes sent, 0 if the socket is not ready and -1 if the
+// connection failed.
+ssize_t send_some(connection &conn) {
+    const char *data = conn.out.data() + conn.written;
+    size_t len = conn.out.size() - conn.written;
+    if (conn.ssl) {
+        int n = SSL_write(conn.ssl, data, static_cast<int>(len));
+        if (n > 0)
+            return n;
+        return tls_wait(conn, n) ? 0 : -1;
+    }
+    ssize_t n = ::send(conn.fd, data, len, MSG_NOSIGNAL);
+    if (n >= 0)
+        return n;
+    if (errno == EAGAIN || errno == EINTR) {
+        conn.events = POLLOUT;
+        return 0;
+    }
+    finish(conn, failure(std::strerror(errno)));
+    return -1;
+}
+
+// Returns the bytes received, 0 at the end of the stream, -2 if the socket
+// is not ready and -1 if the connection failed.
+ssize_t recv_some(connection &conn, char *buf, size_t len) {
+    if (conn.ssl) {
+        int n = SSL_read(conn.ssl, buf, static_cast<int>(len));
+        if (n > 0)
+            return n;
+        int err = SSL_get_error(conn.ssl, n);
+        if (err == SSL_ERROR_ZERO_RETURN)
+            return 0;
+        return tls_wait(conn, n) ? -2 : -1;
+    }
+    while (true) {
+        ssize_t n = ::recv(conn.fd, buf, len, 0);
+        if (n >= 0)
+            return n;
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN) {
+            conn.events = POLLIN;
+            return -2;
+        }
+        finish(conn, failure(std::strerror(errno)));
+        return -1;
+    }
+}
+
+// Moves a connection on as far as its socket allows: connect, TLS
+// handshake, sending the request and reading the response.
+void advance(connection &conn) {
+    if (!conn.connected) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        ::getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            finish(conn, failure(std::strerror(err)));
+            return;
+        }
+        conn.connected = true;
+    }
+    if (conn.ssl && !conn.handshaken) {
+        int ret = SSL_do_handshake(conn.ssl);
+        if (ret != 1) {
+            tls_wait(conn, ret);
+            return;
+        }
+        conn.handshaken = true;
+    }
+    while (conn.written < conn.out.size()) {
+        ssize_t n = send_some(conn);
+        if (n <= 0)
+            return;
+        conn.written += n;
+    }
+
+    char buf[16384];
+    bool eof = false;
+    while (true) {
+        ssize_t n = recv_some(conn, buf, sizeof(buf));
+        if (n == -1)
+            return;
+        if (n == -2)
+            break;
+        if (n == 0) {
+            eof = true;
+            break;
+        }
+        conn.in.append(buf, n);
+    }
+    if (parse_response(conn.in, eof, conn.parser)) {
+        auto &res = conn.parser.res;
+        if (res.error.empty())
+            decode_body(res);
+        finish(conn, std::move(res));
+    }
+}
+
+} // namespace
+
+namespace lany {
+namespace util {
+
+bool parse_url(std::string_view url, http_url &out) {
+    if (url.starts_with("http://")) {
+        out.tls = false;
+        out.port = 80;
+        url.remove_prefix(7);
+    } else if (url.starts_with("https://")) {
+        out.tls = true;
+        out.port = 443;
+        url.remove_prefix(8);
+    } else {
+        return false;
+    }
+    url = url.substr(0, url.find('#'));
+
+    size_t slash = url.find_first_of("/?");
+    auto authority = url.substr(0, slash);
+    out.target = slash == std::string_view::npos ? "/" : url.substr(slash);
+    if (out.target.front() == '?')
+        out.target.insert(0, "/");
+
+    size_t colon = authority.rfind(':');
+    if (colon != std::string_view::npos &&
+        authority.find(']', colon) == std::string_view::npos) {
+        auto port = authority.substr(colon + 1);
+        if (port.empty() || port.size() > 5 ||
+            !std::all_of(port.begin(), port.end(), ::isdigit))
+            return false;
+        unsigned long val = std::stoul(std::string(port));
+        if (val == 0 || val > 65535)
+            return false;
+        out.port = static_cast<uint16_t>(val);
+        authority = authority.substr(0, colon);
+    }
+    if (authority.size() > 2 && authority.front() == '[' &&
+        authority.back() == ']')
+        authority = authority.substr(1, authority.size() - 2);
+    out.host = authority;
+    return !out.host.empty();
+}
+
+// A host name being resolved off the client thread. The resolver fills in
+// the address under the client mutex; the client thread owns the rest.
+struct http_client::lookup {
+    request req;
+    bool resolved = false;
+    sockaddr_storage addr{};
+    socklen_t addr_len = 0;
+};
+
+http_client::http_client() : resolver(new thread_pool(resolver_threads)) {
+    tls = SSL_CTX_new(TLS_client_method());
+    if (tls) {
+        SSL_CTX_set_min_proto_version(tls, TLS1_2_VERSION);
+        SSL_CTX_set_verify(tls, SSL_VERIFY_PEER, nullptr);
+        SSL_CTX_set_default_verify_paths(tls);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+        // servers closing without close_notify end the body like plain tcp
+        SSL_CTX_set_options(tls, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+    }
+    if (::pipe2(wake_fds, O_NONBLOCK | O_CLOEXEC) == 0)
+        thread = std::thread(&http_client::run, this);
+}
+
+http_client::~http_client() {
+    {
+        std::lock_guard lock(mtx);
+        stopping = true;
+    }
+    if (thread.joinable()) {
+        wake();
+        thread.join();
+    }
+    // lets outstanding lookups finish; their requests were failed by run()
+    resolver.reset();
+    for (int fd : wake_fds)
+        if (fd >= 0)
+            ::close(fd);
+    if (tls)
+        SSL_CTX_free(tls);
+}
+
+void http_client::wake() {
+    char c = 0;
+    (void)::write(wake_fds[1], &c, 1);
+}
+
+void http_client::redirect(const std::string &host, uint16_t port) {
+    std::lock_guard lock(mtx);
+    redirect_host = host;
+    redirect_port = port;
+}
+
+void http_client::get(std::string_view url, std::chrono::milliseconds timeout,
+                      callback done, replay_key key) {
+    request req;
+    if (!parse_url(url, req.url)) {
+        done(failure("invalid url"));
+        return;
+    }
+    req.deadline = clock::now() + timeout;
+    req.done = std::move(done);
+    req.key = key;
+    {
+        std::lock_guard lock(mtx);
+        if (!redirect_host.empty()) {
+            req.url.target.insert(0, "/" + req.url.host);
+            req.url.host = redirect_host;
+            req.url.port = redirect_port;
+            req.url.tls = false;
+            req.redirected = true;
+        }
+        if (thread.joinable() && (!req.url.tls || tls)) {
+            queued.push_back(std::move(req));
+            req.done = nullptr;
+        }
+    }
+    if (req.done) {
+        req.done(failure(thread.joinable() ? "https is not available"
+                                           : "client is not running"));
+        return;
+    }
+    wake();
+}
+
+void http_client::run() {
+    std::vector<connection> conns;
+    std::vector<std::shared_ptr<lookup>> lookups;
+    std::vector<pollfd> fds;
+    auto start = [&](lookup &l) {
+        auto &req = l.req;
+        connection conn;
+        conn.fd = open_connection(l.addr, l.addr_len);
+        if (conn.fd >= 0 && req.url.tls) {
+            conn.ssl = open_tls(tls, conn.fd, req.url.host);
+            if (!conn.ssl) {
+                ::close(conn.fd);
+                conn.fd = -1;
+            }
+        }
+        if (conn.fd < 0) {
+            req.done(failure("could not connect to " + req.url.host));
+            return;
+        }
+        conn.out = "GET " + req.url.target + " HTTP/1.1\r\nHost: " +
+                   req.url.host + "\r\nUser-Agent: searxpp\r\n"
+                   "Accept: */*\r\nAccept-Encoding: " +
+                   accept_encoding + "\r\n";
+        if (req.redirected && req.key.search >= 0)
+            conn.out += "X-Replay-Key: " + std::to_string(req.key.search) +
+                        "." + std::to_string(req.key.fetch) + "\r\n";
+        conn.out += "Connection: close\r\n\r\n";
+        conn.deadline = req.deadline;
+        conn.done = std::move(req.done);
+        conns.push_back(std::move(conn));
+    };
+
+    while (true) {
+        std::deque<request> fresh;
+        std::vector<std::shared_ptr<lookup>> ready;
+        {
+            std::lock_guard lock(mtx);
+            if (stopping)
+                break;
+            fresh.swap(queued);
+            std::erase_if(lookups, [&](auto &l) {
+                if (l->resolved)
+                    ready.push_back(l);
+                return l->resolved;
+            });
+        }
+        for (auto &req : fresh) {
+            auto l = std::make_shared<lookup>();
+            l->req = std::move(req);
+            // numeric hosts (and the replay upstream) need no lookup
+            auto &host = l->req.url.host;
+            auto *in4 = reinterpret_cast<sockaddr_in *>(&l->addr);
+            auto *in6 = reinterpret_cast<sockaddr_in6 *>(&l->addr);
+            if (::inet_pton(AF_INET, host.c_str(), &in4->sin_addr) == 1) {
+                in4->sin_family = AF_INET;
+                in4->sin_port = htons(l->req.url.port);
+                l->addr_len = sizeof(*in4);
+                start(*l);
+                continue;
+            }
+            if (::inet_pton(AF_INET6, host.c_str(), &in6->sin6_addr) == 1) {
+                in6->sin6_family = AF_INET6;
+                in6->sin6_port = htons(l->req.url.port);
+                l->addr_len = sizeof(*in6);
+                start(*l);
+                continue;
+            }
+            lookups.push_back(l);
+            resolver->submit([this, l, host = host,
+                              port = std::to_string(l->req.url.port)] {
+                addrinfo hints{};
+                hints.ai_family = AF_UNSPEC;
+                hints.ai_socktype = SOCK_STREAM;
+                addrinfo *res = nullptr;
+                int err = ::getaddrinfo(host.c_str(), port.c_str(), &hints,
+                                        &res);
+                std::lock_guard lock(mtx);
+                if (err == 0) {
+                    std::memcpy(&l->addr, res->ai_addr, res->ai_addrlen);
+                    l->addr_len = res->ai_addrlen;
+                    ::freeaddrinfo(res);
+                }
+                l->resolved = true;
+                if (!stopping)
+                    wake();
+            });
+        }
+        for (auto &l : ready) {
+            if (l->addr_len == 0)
+                l->req.done(failure("could not resolve " + l->req.url.host));
+            else
+                start(*l);
+        }
+
+        fds.assign(1, {wake_fds[0], POLLIN, 0});
+        auto next = clock::time_point::max();
+        for (auto &conn : conns) {
+            fds.push_back({conn.fd, conn.events, 0});
+            next = std::min(next, conn.deadline);
+        }
+        for (auto &l : lookups)
+            next = std::min(next, l->req.deadline);
+        int timeout = -1;
+        if (next != clock::time_point::max()) {
+            auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+                next - clock::now());
+            timeout = static_cast<int>(std::max<int64_t>(0, wait.count()));
+        }
+        if (::poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR)
+            break;
+
+        char buf[64];
+        while (::read(wake_fds[0], buf, sizeof(buf)) > 0)
+            ;
+        auto now = clock::now();
+        for (size_t i = 0; i < conns.size(); i++) {
+            auto &conn = conns[i];
+            if (fds[i + 1].revents)
+                advance(conn);
+            if (conn.fd >= 0 && conn.deadline <= now) {
+                auto res = failure("timeout");
+                res.timed_out = true;
+                finish(conn, std::move(res));
+            }
+        }
+        std::erase_if(conns, [](auto &conn) { return conn.fd < 0; });
+        // a lookup that outlives its deadline is dropped; the resolver
+        // still completes it, but nobody is waiting any more
+        std::vector<std::shared_ptr<lookup>> expired;
+        {
+            std::lock_guard lock(mtx);
+            std::erase_if(lookups, [&](auto &l) {
+                bool late = !l->resolved && l->req.deadline <= now;
+                if (late)
+                    expired.push_back(l);
+                return late;
+            });
+        }
+        for (auto &l : expired) {
+            auto res = failure("timeout");
+            res.timed_out = true;
+            l->req.done(std::move(res));
+        }
+    }
+
+    for (auto &conn : conns)
+        finish(conn, failure("client stopped"));
+    for (auto &l : lookups)
+        l->req.done(failure("client stopped"));
+    std::deque<request> rest;
+    {
+        std::lock_guard lock(mtx);
+        rest.swap(queued);
+    }
+    for (auto &req : rest)
+        req.done(failure("client stopped"));
+}
+
+} // namespace util
+} // namespace lany
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct ssl_ctx_st;
+
+namespace lany {
+
+namespace util {
+
+struct http_url {
+    bool tls = false;
+    std::string host;
+    uint16_t port = 80;
+    std::string target; // path and query
+};
+
+bool parse_url(std::string_view url, http_url &out);
+
+struct http_response {
+    int status = 0;
+    // names lowercased
+    std::vector<std::pair<std::string, std::string>> headers;
+    // raw bytes, already decoded from the Content-Encoding
+    std::string body;
+    // set when no response was received
+    std::string error;
+    // the error is that the deadline passed
+    bool timed_out = false;
+};
+
+// Identifies a request across replays of the same load: the caller's
+// number for the search that made it and its position among that search's
+// requests. Unlike arrival order it does not depend on how concurrent
+// searches interleave.
+struct replay_key {
+    int64_t search = -1; // -1 when the request belongs to no search
+    uint32_t fetch = 0;
+};
+
+class thread_pool;
+
+// Minimal HTTP/1.1 client. All requests are multiplexed over non-blocking
+// sockets by one background thread, so thousands can be in flight without
+// tying up pool threads; callbacks run on that thread. Host names are
+// resolved on a few resolver threads so a slow lookup does not stall the
+// other requests. https certificates are checked against the system store.
+class http_client {
+public:
+    using clock = std::chrono::steady_clock;
+    using callback = std::function<void(http_response)>;
+
+    struct request {
+        http_url url;
+        clock::time_point deadline;
+        callback done;
+        replay_key key;
+        bool redirected = false;
+    };
+    struct lookup;
+
+private:
+    std::thread thread;
+    std::unique_ptr<thread_pool> resolver;
+    ssl_ctx_st *tls = nullptr;
+    std::mutex mtx;
+    std::deque<request> queued;
+    std::string redirect_host;
+    uint16_t redirect_port = 0;
+    int wake_fds[2] = {-1, -1};
+    bool stopping = false;
+
+    void wake();
+    void run();
+
+public:
+    http_client();
+    http_client(const http_client &) = delete;
+    http_client &operator=(const http_client &) = delete;
+    ~http_client();
+
+    // Sends every request to host:port over plain http instead, with the
+    // original host prepended to the path ("/example.com/search?q=x") and
+    // the request's replay key in an "X-Replay-Key: <search>.<fetch>"
+    // header. Lets recorded upstreams be replayed locally without touching
+    // engine scripts.
+    void redirect(const std::string &host, uint16_t port);
+    void get(std::string_view url, std::chrono::milliseconds timeout,
+             callback done, replay_key key = {});
+};
+
+} // namespace util
+
+} // namespace lany
@@ -0,0 +1,324 @@
+#include "log.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/fmt/chrono.h>
+#include <spdlog/spdlog.h>
+#if defined(_WIN32) || defined(_WIN64)
+#include <spdlog/sinks/wincolor_sink.h>
+using console_sink_mt = spdlog::sinks::wincolor_stderr_sink_mt;
+#else
+#include <spdlog/sinks/stdout_color_sinks.h>
+using console_sink_mt = spdlog::sinks::stderr_color_sink_mt;
+#endif
+
+namespace {
+
+using namespace lany::util::log;
+using detail::Slot;
+
+constexpr char binary_magic[8] = {'S', 'X', 'P', 'P', 'L', 'O', 'G', '1'};
+constexpr size_t slot_header_size = offsetof(Slot, msg);
+constexpr size_t ring_size = 256;
+
+struct Ring {
+    Slot slots[ring_size];
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<bool> alive{true};
+    uint16_t thread = 0;
+};
+
+std::atomic<uint8_t> current_level{info};
+std::atomic<uint32_t> sample_rate[max_engines];
+std::atomic<uint32_t> sample_count[max_engines];
+
+constexpr spdlog::level::level_enum to_spdlog(uint8_t lvl) {
+    return static_cast<spdlog::level::level_enum>(
+        std::min<uint8_t>(lvl, spdlog::level::off));
+}
+
+constexpr const char *level_name(uint8_t lvl) {
+    constexpr const char *names[] = {"trace", "debug",    "info", "warning",
+                                     "error", "critical", "off"};
+    return lvl < std::size(names) ? names[lvl] : "?";
+}
+
+class Backend {
+    std::mutex mtx;
+    std::vector<std::shared_ptr<Ring>> rings;
+    uint16_t next_thread = 0;
+    spdlog::logger text{"searxpp", std::make_shared<console_sink_mt>()};
+    std::FILE *binary = nullptr;
+
+    std::mutex wait_mtx;
+    std::condition_variable cv;
+    std::condition_variable flushed;
+    bool wake = false;
+    bool stopping = false;
+    uint64_t flush_req = 0;
+    uint64_t flush_done = 0;
+
+    std::atomic<uint64_t> _dropped{0};
+    std::thread thread;
+
+    void emit(Slot &slot) {
+        bool spilled = slot.flags & detail::slot_spilled;
+        std::string_view msg(spilled ? slot.spill : slot.msg, slot.len);
+        if (binary) {
+            // the flags are meaningless in a file; the text always follows
+            // the header
+            std::fwrite(&slot, 1, slot_header_size, binary);
+            std::fwrite(msg.data(), 1, msg.size(), binary);
+        } else {
+            auto time = spdlog::log_clock::time_point(
+                std::chrono::duration_cast<spdlog::log_clock::duration>(
+                    std::chrono::nanoseconds(slot.timestamp)));
+            if (slot.engine == no_engine) {
+                text.log(time, {}, to_spdlog(slot.level), msg);
+            } else {
+                fmt::memory_buffer buf;
+                fmt::format_to(std::back_inserter(buf), "[engine {}] {}",
+                               slot.engine, msg);
+                text.log(time, {}, to_spdlog(slot.level),
+                         std::string_view(buf.data(), buf.size()));
+            }
+        }
+        if (spilled) {
+            delete[] slot.spill;
+            slot.flags = 0;
+        }
+    }
+
+    void drain() {
+        std::lock_guard lock(mtx);
+        for (auto it = rings.begin(); it != rings.end();) {
+            Ring &ring = **it;
+            uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+            uint64_t head = ring.head.load(std::memory_order_acquire);
+            for (; tail < head; tail++)
+                emit(ring.slots[tail % ring_size]);
+            ring.tail.store(tail, std::memory_order_release);
+            // the owning thread is gone and everything it wrote is out
+            if (!ring.alive.load(std::memory_order_acquire) &&
+                ring.head.load(std::memory_order_acquire) == tail)
+                it = rings.erase(it);
+            else
+                ++it;
+        }
+        if (binary)
+            std::fflush(binary);
+        else
+            text.flush();
+    }
+
+    void run() {
+        while (true) {
+            uint64_t req;
+            bool stop;
+            {
+                std::unique_lock lock(wait_mtx);
+                cv.wait_for(lock, std::chrono::milliseconds(20),
+                            [this] { return wake || stopping; });
+                wake = false;
+                req = flush_req;
+                stop = stopping;
+            }
+            drain();
+            {
+                std::lock_guard lock(wait_mtx);
+                flush_done = std::max(flush_done, req);
+            }
+            flushed.notify_all();
+            if (stop)
+                return;
+        }
+    }
+
+public:
+    Backend() {
+        text.set_level(spdlog::level::trace);
+        thread = std::thread(&Backend::run, this);
+    }
+
+    ~Backend() {
+        {
+            std::lock_guard lock(wait_mtx);
+            stopping = true;
+        }
+        cv.notify_one();
+        thread.join();
+        if (binary)
+            std::fclose(binary);
+    }
+
+    static Backend &get() {
+        static Backend backend;
+        return backend;
+    }
+
+    std::shared_ptr<Ring> add_ring() {
+        auto ring = std::make_shared<Ring>();
+        std::lock_guard lock(mtx);
+        ring->thread = next_thread++;
+        rings.push_back(ring);
+        return ring;
+    }
+
+    void notify() {
+        {
+            std::lock_guard lock(wait_mtx);
+            wake = true;
+        }
+        cv.notify_one();
+    }
+
+    void flush() {
+        std::unique_lock lock(wait_mtx);
+        uint64_t ticket = ++flush_req;
+        wake = true;
+        cv.notify_one();
+        flushed.wait(lock, [&] { return flush_done >= ticket || stopping; });
+    }
+
+    int open_binary(const std::string &path) {
+        std::FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return -1;
+        std::fwrite(binary_magic, 1, sizeof(binary_magic), file);
+        std::lock_guard lock(mtx);
+        if (binary)
+            std::fclose(binary);
+        binary = file;
+        return 0;
+    }
+
+    void drop() { _dropped.fetch_add(1, std::memory_order_relaxed); }
+    uint64_t dropped() const {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+};
+
+struct LocalRing {
+    std::shared_ptr<Ring> ring;
+    uint64_t head = 0;
+
+    ~LocalRing() {
+        if (ring)
+            ring->alive.store(false, std::memory_order_release);
+    }
+};
+
+thread_local LocalRing local;
+
+} // namespace
+
+namespace lany {
+namespace util {
+namespace log {
+
+void set_level(level lvl) noexcept {
+    current_level.store(lvl, std::memory_order_relaxed);
+}
+
+void set_sample_rate(uint32_t engine, uint32_t n) noexcept {
+    if (engine < max_engines)
+        sample_rate[engine].store(n, std::memory_order_relaxed);
+}
+
+bool should_log(level lvl, uint32_t engine) noexcept {
+    if (lvl < current_level.load(std::memory_order_relaxed))
+        return false;
+    if (engine >= max_engines || lvl >= error)
+        return true;
+    uint32_t rate = sample_rate[engine].load(std::memory_order_relaxed);
+    if (rate <= 1)
+        return true;
+    return sample_count[engine].fetch_add(1, std::memory_order_relaxed) %
+               rate ==
+           0;
+}
+
+int open_binary(const std::string &path) {
+    return Backend::get().open_binary(path);
+}
+
+void flush() { Backend::get().flush(); }
+
+uint64_t dropped() noexcept { return Backend::get().dropped(); }
+
+namespace detail {
+
+Slot *reserve() noexcept {
+    if (!local.ring) {
+        try {
+            local.ring = Backend::get().add_ring();
+        } catch (...) {
+            return nullptr;
+        }
+    }
+    Ring &ring = *local.ring;
+    local.head = ring.head.load(std::memory_order_relaxed);
+    if (local.head - ring.tail.load(std::memory_order_acquire) >= ring_size) {
+        Backend::get().drop();
+        return nullptr;
+    }
+    Slot *slot = &ring.slots[local.head % ring_size];
+    slot->timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+    slot->thread = ring.thread;
+    slot->flags = 0;
+    return slot;
+}
+
+void commit(level lvl) noexcept {
+    local.ring->head.store(local.head + 1, std::memory_order_release);
+    if (lvl >= warn)
+        Backend::get().notify();
+}
+
+} // namespace detail
+
+int decode(std::istream &in, std::ostream &out) {
+    char magic[sizeof(binary_magic)];
+    if (!in.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, binary_magic, sizeof(magic)) != 0)
+        return -1;
+    Slot slot;
+    std::string msg;
+    while (in.read(reinterpret_cast<char *>(&slot), slot_header_size)) {
+        msg.resize(slot.len);
+        if (!in.read(msg.data(), slot.len))
+            return -1;
+        auto time = std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::nanoseconds(slot.timestamp)));
+        auto us = slot.timestamp / 1000 % 1000000;
+        out << fmt::format("[{:%Y-%m-%d %H:%M:%S}.{:06}] [{}] [thread {}] ",
+                           fmt::gmtime(std::chrono::system_clock::to_time_t(
+                               time)),
+                           us, level_name(slot.level), slot.thread);
+        if (slot.engine != no_engine)
+            out << "[engine " << slot.engine << "] ";
+        out << msg << '\n';
+    }
+    return 0;
+}
+
+} // namespace log
+} // namespace util
+} // namespace lany
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+
+#include <spdlog/fmt/fmt.h>
+
+// Levels below LANY_LOG_ACTIVE_LEVEL are compiled out: their arguments are
+// never evaluated and nothing is formatted.
+#define LANY_LOG_LEVEL_TRACE 0
+#define LANY_LOG_LEVEL_DEBUG 1
+#define LANY_LOG_LEVEL_INFO 2
+#define LANY_LOG_LEVEL_WARN 3
+#define LANY_LOG_LEVEL_ERROR 4
+#define LANY_LOG_LEVEL_CRITICAL 5
+#define LANY_LOG_LEVEL_OFF 6
+
+#ifndef LANY_LOG_ACTIVE_LEVEL
+#ifdef NDEBUG
+#define LANY_LOG_ACTIVE_LEVEL LANY_LOG_LEVEL_INFO
+#else
+#define LANY_LOG_ACTIVE_LEVEL LANY_LOG_LEVEL_DEBUG
+#endif
+#endif
+
+#define LANY_LOG(lvl, engine, ...)                                             \
+    do {                                                                       \
+        if constexpr (LANY_LOG_LEVEL_##lvl >= LANY_LOG_ACTIVE_LEVEL) {         \
+            constexpr auto _lany_lvl =                                         \
+                static_cast<::lany::util::log::level>(LANY_LOG_LEVEL_##lvl);   \
+            if (::lany::util::log::should_log(_lany_lvl, engine))              \
+                ::lany::util::log::log(_lany_lvl, engine, __VA_ARGS__);        \
+        }                                                                      \
+    } while (0)
+
+#define LANY_LOG_TRACE(...)                                                    \
+    LANY_LOG(TRACE, ::lany::util::log::no_engine, __VA_ARGS__)
+#define LANY_LOG_DEBUG(...)                                                    \
+    LANY_LOG(DEBUG, ::lany::util::log::no_engine, __VA_ARGS__)
+#define LANY_LOG_INFO(...)                                                     \
+    LANY_LOG(INFO, ::lany::util::log::no_engine, __VA_ARGS__)
+#define LANY_LOG_WARN(...)                                                     \
+    LANY_LOG(WARN, ::lany::util::log::no_engine, __VA_ARGS__)
+#define LANY_LOG_ERROR(...)                                                    \
+    LANY_LOG(ERROR, ::lany::util::log::no_engine, __VA_ARGS__)
+#define LANY_LOG_CRITICAL(...)                                                 \
+    LANY_LOG(CRITICAL, ::lany::util::log::no_engine, __VA_ARGS__)
+
+namespace lany {
+
+namespace util {
+
+// Asynchronous logging.
+//
+// Every thread formats into its own single-producer ring of fixed-size
+// slots; a background thread drains all rings into the output. Producers
+// never lock or block: a full ring drops the record and counts it. Records
+// tagged with an engine id can be sampled per engine. Messages longer than a
+// slot spill into a heap block, up to max_spilled_message bytes.
+//
+// Output is text through spdlog, or a binary file of raw records (see
+// open_binary) that decode() turns back into text offline.
+namespace log {
+
+enum level : uint8_t { trace, debug, info, warn, error, critical, off };
+
+constexpr uint32_t no_engine = 0xffff;
+constexpr size_t max_engines = 1024;
+constexpr size_t max_message = 232;
+constexpr size_t max_spilled_message = UINT16_MAX;
+
+void set_level(level lvl) noexcept;
+// Keeps one in `n` records of `engine`; 0 or 1 keeps all.
+void set_sample_rate(uint32_t engine, uint32_t n) noexcept;
+bool should_log(level lvl, uint32_t engine) noexcept;
+
+// Writes subsequent records to `path` in the binary format.
+int open_binary(const std::string &path);
+// Blocks until every record logged so far has been written.
+void flush();
+uint64_t dropped() noexcept;
+// Converts a binary log to text. Returns -1 on a malformed file.
+int decode(std::istream &in, std::ostream &out);
+
+namespace detail {
+// the text lives in `spill`, owned by the slot, instead of `msg`
+constexpr uint8_t slot_spilled = 1;
+
+struct Slot {
+    uint64_t timestamp;
+    uint16_t engine;
+    uint8_t level;
+    uint8_t flags;
+    uint16_t len;
+    uint16_t thread;
+    union {
+        char msg[max_message];
+        char *spill;
+    };
+};
+
+Slot *reserve() noexcept;
+void commit(level lvl) noexcept;
+} // namespace detail
+
+template <typename... Args>
+void log(level lvl, uint32_t engine, fmt::format_string<Args...> format,
+         Args &&...args) noexcept {
+    detail::Slot *slot = detail::reserve();
+    if (!slot)
+        return;
+    slot->level = lvl;
+    slot->engine = static_cast<uint16_t>(engine);
+    try {
+        auto store = fmt::make_format_args(args...);
+        auto res = fmt::vformat_to_n(slot->msg, max_message, format, store);
+        size_t len = std::min(res.size, max_spilled_message);
+        if (len > max_message) {
+            // rare: format again into a block of the exact size
+            std::unique_ptr<char[]> buf(new (std::nothrow) char[len]);
+            if (buf) {
+                fmt::vformat_to_n(buf.get(), len, format, store);
+                slot->spill = buf.release();
+                slot->flags = detail::slot_spilled;
+            } else {
+                len = max_message;
+            }
+        }
+        slot->len = static_cast<uint16_t>(len);
+    } catch (...) {
+        slot->len = 0;
+    }
+    detail::commit(lvl);
+}
+
+} // namespace log
+
+} // namespace util
+
+} // namespace lany
@@ -0,0 +1,52 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace lany {
+namespace util {
+
+thread_pool::thread_pool(size_t size) {
+    if (size == 0)
+        size = std::max(1u, std::thread::hardware_concurrency());
+    threads.reserve(size);
+    for (size_t i = 0; i < size; i++)
+        threads.emplace_back(&thread_pool::run, this);
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto &t : threads)
+        t.join();
+}
+
+size_t thread_pool::size() const { return threads.size(); }
+
+void thread_pool::submit(std::function<void()> task) {
+    {
+        std::lock_guard lock(mtx);
+        tasks.emplace_back(std::move(task));
+    }
+    cv.notify_one();
+}
+
+void thread_pool::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mtx);
+            cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace util
+} // namespace lany
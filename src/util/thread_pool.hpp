@@ -0,0 +1,36 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lany {
+
+namespace util {
+
+class thread_pool {
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    void run();
+
+public:
+    thread_pool(size_t size = 0);
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+    ~thread_pool();
+
+    size_t size() const;
+    void submit(std::function<void()> task);
+};
+
+} // namespace util
+
+} // namespace lany
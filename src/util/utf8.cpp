@@ -0,0 +1,266 @@
+#include "utf8.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LANY_UTF8_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LANY_UTF8_NEON 1
+#endif
+
+namespace {
+
+// Length of the leading run of ASCII bytes.
+size_t ascii_prefix(const uint8_t *data, size_t len) {
+    size_t i = 0;
+#if defined(LANY_UTF8_SSE2)
+    for (; i + 16 <= len; i += 16) {
+        __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        if (_mm_movemask_epi8(v))
+            break;
+    }
+#elif defined(LANY_UTF8_NEON)
+    for (; i + 16 <= len; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(data + i)) & 0x80)
+            break;
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        std::memcpy(&v, data + i, 8);
+        if (v & 0x8080808080808080ull)
+            break;
+    }
+#endif
+    while (i < len && data[i] < 0x80)
+        i++;
+    return i;
+}
+
+// Decodes the sequence at the start of `data` into `cp` and returns its
+// length. A byte that does not start a complete sequence decodes alone as
+// U+FFFD.
+size_t decode(const uint8_t *data, size_t len, uint32_t &cp) {
+    uint8_t c = data[0];
+    size_t n = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+    cp = 0xfffd;
+    if (n == 1 || n > len)
+        return 1;
+    uint32_t v = c & (0x7f >> n);
+    for (size_t k = 1; k < n; k++) {
+        if ((data[k] & 0xc0) != 0x80)
+            return 1;
+        v = v << 6 | (data[k] & 0x3f);
+    }
+    cp = v;
+    return n;
+}
+
+// Spaces and punctuation outside ASCII that separate words.
+bool is_separator(uint32_t cp) {
+    struct range {
+        uint32_t lo, hi;
+    };
+    static constexpr range ranges[] = {
+        {0x00a0, 0x00a9}, // NBSP and Latin-1 punctuation, but not the
+        {0x00ab, 0x00b4}, // letters U+00AA, U+00B5 and U+00BA
+        {0x00b6, 0x00b9}, //
+        {0x00bb, 0x00bf}, //
+        {0x00d7, 0x00d7}, // multiplication sign
+        {0x00f7, 0x00f7}, // division sign
+        {0x2000, 0x206f}, // General Punctuation
+        {0x2e00, 0x2e7f}, // Supplemental Punctuation
+        {0x3000, 0x3003}, // ideographic space, comma and full stop
+        {0x3008, 0x3011}, // CJK brackets
+        {0xfeff, 0xfeff}, // zero width no-break space
+    };
+    if (cp < ranges[0].lo)
+        return false;
+    for (auto r : ranges) {
+        if (cp <= r.hi)
+            return cp >= r.lo;
+    }
+    return false;
+}
+
+// Whether the character at data[0] belongs to a word; sets `n` to its
+// length.
+inline bool is_word(const uint8_t *data, size_t len, size_t &n) {
+    uint8_t c = data[0];
+    if (c < 0x80) {
+        n = 1;
+        return (c >= '0' && c <= '9') ||
+               ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+    }
+    uint32_t cp;
+    n = decode(data, len, cp);
+    return !is_separator(cp);
+}
+
+inline bool ascii_iequal(std::string_view a, std::string_view b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        uint8_t c = a[i];
+        if (c >= 'A' && c <= 'Z')
+            c |= 0x20;
+        if (c != static_cast<uint8_t>(b[i]))
+            return false;
+    }
+    return true;
+}
+
+// Appends `text` with the characters that are special in HTML text and
+// attribute values replaced by entities.
+void append_escaped(std::string &out, std::string_view text) {
+    while (!text.empty()) {
+        size_t n = text.find_first_of("&<>\"'");
+        out.append(text.substr(0, n));
+        if (n == std::string_view::npos)
+            break;
+        switch (text[n]) {
+        case '&':
+            out += "&amp;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '"':
+            out += "&quot;";
+            break;
+        default:
+            out += "&#39;";
+        }
+        text.remove_prefix(n + 1);
+    }
+}
+
+} // namespace
+
+namespace lany {
+namespace util {
+
+bool is_ascii(const uint8_t *data, size_t len) {
+    return ascii_prefix(data, len) == len;
+}
+
+bool validate_utf8(const uint8_t *data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        i += ascii_prefix(data + i, len - i);
+        if (i >= len)
+            break;
+        uint8_t c = data[i];
+        size_t n;
+        uint8_t lo = 0x80, hi = 0xbf;
+        if (c >= 0xc2 && c <= 0xdf) {
+            n = 1;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            n = 2;
+            if (c == 0xe0)
+                lo = 0xa0; // overlong
+            else if (c == 0xed)
+                hi = 0x9f; // surrogates
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            n = 3;
+            if (c == 0xf0)
+                lo = 0x90; // overlong
+            else if (c == 0xf4)
+                hi = 0x8f; // above U+10FFFF
+        } else {
+            return false;
+        }
+        if (len - i <= n)
+            return false;
+        if (data[i + 1] < lo || data[i + 1] > hi)
+            return false;
+        for (size_t k = 2; k <= n; k++) {
+            if ((data[i + k] & 0xc0) != 0x80)
+                return false;
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+void ascii_lower(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t i = 0;
+#if defined(LANY_UTF8_SSE2)
+    const __m128i a = _mm_set1_epi8('A' - 1);
+    const __m128i z = _mm_set1_epi8('Z' + 1);
+    const __m128i bit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        // signed compares leave bytes >= 0x80 (negative) untouched
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, a),
+                                      _mm_cmplt_epi8(v, z));
+        v = _mm_or_si128(v, _mm_and_si128(upper, bit));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), v);
+    }
+#elif defined(LANY_UTF8_NEON)
+    const uint8x16_t a = vdupq_n_u8('A');
+    const uint8x16_t range = vdupq_n_u8('Z' - 'A');
+    const uint8x16_t bit = vdupq_n_u8(0x20);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(in + i);
+        uint8x16_t upper = vcleq_u8(vsubq_u8(v, a), range);
+        vst1q_u8(out + i, vorrq_u8(v, vandq_u8(upper, bit)));
+    }
+#endif
+    for (; i < len; i++) {
+        uint8_t c = in[i];
+        out[i] = (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+    }
+}
+
+void tokenize(std::string_view text, std::vector<token_span> &out) {
+    auto data = reinterpret_cast<const uint8_t *>(text.data());
+    size_t len = text.size();
+    size_t i = 0, n;
+    while (i < len) {
+        while (i < len && !is_word(data + i, len - i, n))
+            i += n;
+        size_t begin = i;
+        while (i < len && is_word(data + i, len - i, n))
+            i += n;
+        if (i > begin)
+            out.emplace_back(begin, i);
+    }
+}
+
+std::string highlight(std::string_view text,
+                      const std::vector<std::string> &terms,
+                      std::string_view open, std::string_view close) {
+    std::vector<token_span> tokens;
+    tokenize(text, tokens);
+
+    std::string ret;
+    ret.reserve(text.size() + 16);
+    size_t last = 0;
+    for (auto [begin, end] : tokens) {
+        auto token = text.substr(begin, end - begin);
+        bool match = std::any_of(terms.begin(), terms.end(),
+                                 [&](const std::string &term) {
+                                     return ascii_iequal(token, term);
+                                 });
+        if (!match)
+            continue;
+        append_escaped(ret, text.substr(last, begin - last));
+        ret.append(open);
+        append_escaped(ret, token);
+        ret.append(close);
+        last = end;
+    }
+    append_escaped(ret, text.substr(last));
+    return ret;
+}
+
+} // namespace util
+} // namespace lany
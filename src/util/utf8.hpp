@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace lany {
+
+namespace util {
+
+using token_span = std::pair<uint32_t, uint32_t>;
+
+bool is_ascii(const uint8_t *data, size_t len);
+// Only runs of ASCII are checked 16 bytes at a time; multi-byte sequences
+// are checked one by one, so mostly non-ASCII text validates at scalar
+// speed.
+bool validate_utf8(const uint8_t *data, size_t len);
+// Lowercases A-Z, copying every other byte unchanged. `out` may alias `in`.
+void ascii_lower(const uint8_t *in, size_t len, uint8_t *out);
+
+// Splits on ASCII characters other than letters and digits and on non-ASCII
+// spaces and punctuation (NBSP, Latin-1 punctuation, × and ÷, General and
+// Supplemental Punctuation, CJK spaces, stops and brackets). Every other
+// code point, including malformed bytes, counts as a word character, so
+// non-ASCII words stay whole. Appends [begin, end) byte offsets to `out`.
+void tokenize(std::string_view text, std::vector<token_span> &out);
+
+// Wraps every token of `text` that matches one of `terms` (already
+// lowercased) case-insensitively for ASCII. The text is HTML-escaped; `open`
+// and `close` are inserted as they are.
+std::string highlight(std::string_view text,
+                      const std::vector<std::string> &terms,
+                      std::string_view open, std::string_view close);
+
+} // namespace util
+
+} // namespace lany
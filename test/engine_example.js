@@ -0,0 +1,16 @@
+import { register } from "searxpp:engine";
+import { fail } from "searxpp:error";
+import { get } from "searxpp:http";
+
+register("example", async (query) => {
+    const res = await get(
+        "https://example.com/search?q=" + encodeURIComponent(query),
+        { timeout: 3000 });
+    if (res.status !== 200)
+        throw fail("upstream", "http-" + res.status, "unexpected status");
+    try {
+        return JSON.parse(res.text()).results;
+    } catch (e) {
+        throw fail("parse", "bad-json", String(e));
+    }
+});
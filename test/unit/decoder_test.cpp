@@ -0,0 +1,143 @@
+#include "check.hpp"
+#include "util/decoder.hpp"
+
+#include <string>
+#include <vector>
+
+#include <brotli/encode.h>
+#include <zlib.h>
+#include <zstd.h>
+
+using namespace lany::util;
+
+namespace {
+
+// window_bits as for deflateInit2: 15 zlib, 31 gzip, -15 raw deflate
+std::string deflate_with(const std::string &in, int window_bits) {
+    z_stream zs{};
+    CHECK(deflateInit2(&zs, 6, Z_DEFLATED, window_bits, 8,
+                       Z_DEFAULT_STRATEGY) == Z_OK);
+    std::string out(deflateBound(&zs, in.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef *>(out.data());
+    zs.avail_out = static_cast<uInt>(out.size());
+    CHECK(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+std::string brotli(const std::string &in) {
+    size_t size = BrotliEncoderMaxCompressedSize(in.size());
+    std::string out(size, '\0');
+    CHECK(BrotliEncoderCompress(
+        BROTLI_DEFAULT_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC,
+        in.size(), reinterpret_cast<const uint8_t *>(in.data()), &size,
+        reinterpret_cast<uint8_t *>(out.data())));
+    out.resize(size);
+    return out;
+}
+
+std::string zstd(const std::string &in) {
+    std::string out(ZSTD_compressBound(in.size()), '\0');
+    size_t size =
+        ZSTD_compress(out.data(), out.size(), in.data(), in.size(), 3);
+    CHECK(!ZSTD_isError(size));
+    out.resize(size);
+    return out;
+}
+
+// Feeds `in` in chunks of `chunk` bytes; returns false on a decode error.
+bool decode(encoding enc, const std::string &in, size_t chunk,
+            std::string &out, bool &finished) {
+    auto dec = decoder::create(enc);
+    pooled_buffer buf;
+    auto data = reinterpret_cast<const uint8_t *>(in.data());
+    for (size_t off = 0; off < in.size(); off += chunk) {
+        if (dec->update(data + off, std::min(chunk, in.size() - off), buf) < 0)
+            return false;
+    }
+    out.assign(reinterpret_cast<char *>(buf.data()), buf.size());
+    finished = dec->finished();
+    return true;
+}
+
+std::string sample(size_t size) {
+    // compressible but not trivially so
+    std::string ret;
+    uint32_t x = 1;
+    while (ret.size() < size) {
+        x = x * 1103515245 + 12345;
+        ret += "result " + std::to_string(x % 1000) + " ";
+    }
+    ret.resize(size);
+    return ret;
+}
+
+void check_round_trip(encoding enc, const std::string &plain,
+                      const std::string &packed) {
+    for (size_t chunk : {size_t(1), size_t(2), size_t(3), size_t(7),
+                         size_t(4096), packed.size() + 1}) {
+        std::string out;
+        bool finished = false;
+        CHECK(decode(enc, packed, chunk, out, finished));
+        CHECK(out == plain);
+        CHECK(finished);
+    }
+}
+
+} // namespace
+
+static void test_round_trips() {
+    // the large sample inflates to more than one output chunk per input byte
+    for (size_t size : {size_t(0), size_t(100), size_t(300000)}) {
+        std::string plain = sample(size);
+        check_round_trip(encoding::gzip, plain, deflate_with(plain, 31));
+        check_round_trip(encoding::deflate, plain, deflate_with(plain, 15));
+        check_round_trip(encoding::deflate, plain, deflate_with(plain, -15));
+        check_round_trip(encoding::br, plain, brotli(plain));
+        check_round_trip(encoding::zstd, plain, zstd(plain));
+    }
+}
+
+static void test_highly_compressible() {
+    std::string plain(1 << 20, 'a');
+    check_round_trip(encoding::gzip, plain, deflate_with(plain, 31));
+    check_round_trip(encoding::deflate, plain, deflate_with(plain, -15));
+}
+
+static void test_multi_member() {
+    std::string a = sample(5000), b = sample(7000);
+    std::string packed = deflate_with(a, 31) + deflate_with(b, 31);
+    check_round_trip(encoding::gzip, a + b, packed);
+
+    std::string zpacked = zstd(a) + zstd(b);
+    check_round_trip(encoding::zstd, a + b, zpacked);
+}
+
+static void test_corrupt() {
+    std::string packed = deflate_with(sample(1000), 31);
+    packed[packed.size() / 2] ^= 0x55;
+    packed[packed.size() / 2 + 1] ^= 0x55;
+    auto dec = decoder::create(encoding::gzip);
+    pooled_buffer buf;
+    bool failed =
+        dec->update(reinterpret_cast<const uint8_t *>(packed.data()),
+                    packed.size(), buf) < 0 ||
+        !dec->finished();
+    CHECK(failed);
+
+    std::string out;
+    bool finished;
+    CHECK(!decode(encoding::br, "not brotli at all", 1, out, finished) ||
+          !finished);
+}
+
+int main() {
+    test_round_trips();
+    test_highly_compressible();
+    test_multi_member();
+    test_corrupt();
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include "check.hpp"
+#include "js/builtins.hpp"
+#include "js/error.hpp"
+#include "js/jsc.hpp"
+#include "script.hpp"
+
+#include <string>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace lany;
+
+namespace {
+
+bool is_error(JSContext *ctx, JSValueConst val) {
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue ctor = JS_GetPropertyStr(ctx, global, "Error");
+    int ret = JS_IsInstanceOf(ctx, val, ctor);
+    JS_FreeValue(ctx, ctor);
+    JS_FreeValue(ctx, global);
+    return ret > 0;
+}
+
+// A TCP port that accepts connections into its backlog but never answers.
+int silent_listener(uint16_t &port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd >= 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    CHECK(bind(fd, reinterpret_cast<sockaddr *>(&addr), len) == 0);
+    CHECK(listen(fd, 16) == 0);
+    CHECK(getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) == 0);
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+} // namespace
+
+// created from native code in a context that never imported the module
+static void test_native_error() {
+    JSRuntime *rt = JS_NewRuntime();
+    JSContext *ctx = JS_NewContext(rt);
+    JSValue err = js::new_engine_error(ctx, js::ErrorCategory::timeout,
+                                       "http-timeout", "timed out");
+    CHECK(!JS_IsException(err));
+    CHECK(is_error(ctx, err));
+    js::ErrorInfo info;
+    CHECK(js::get_engine_error(ctx, err, info));
+    CHECK(info.category == js::ErrorCategory::timeout);
+    CHECK(info.code == "http-timeout" && info.message == "timed out");
+    CHECK(js::describe_error(ctx, err) == "timeout:http-timeout: timed out");
+    JS_FreeValue(ctx, err);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+}
+
+// engines fail the search unless every check in the script holds
+static void test_script_errors() {
+    uint16_t port;
+    int listener = silent_listener(port);
+    TestScript script(
+        "error_test",
+        "import { register } from \"searxpp:engine\";\n"
+        "import { fail, isEngineError } from \"searxpp:error\";\n"
+        "import { get } from \"searxpp:http\";\n"
+        "register(\"fail\", async () => {\n"
+        "    const e = fail(\"parse\", \"bad-json\", \"oops\");\n"
+        "    expect(e instanceof Error, \"instanceof\");\n"
+        "    expect(isEngineError(e), \"isEngineError\");\n"
+        "    expect(e.name === \"EngineError\", \"name\");\n"
+        "    expect(String(e) === \"EngineError parse:bad-json: oops\",\n"
+        "           \"toString\");\n"
+        "    return 1;\n"
+        "});\n"
+        "async function rejection(url) {\n"
+        "    try {\n"
+        "        await get(url, { timeout: 200 });\n"
+        "    } catch (e) {\n"
+        "        expect(e instanceof Error && isEngineError(e), url);\n"
+        "        return e.category + \" \" + e.code;\n"
+        "    }\n"
+        "    throw new Error(\"resolved\");\n"
+        "}\n"
+        "register(\"refused\", async () => {\n"
+        "    expect(await rejection(\"http://127.0.0.1:1/\") ===\n"
+        "           \"upstream http-failed\", \"refused\");\n"
+        "    return 1;\n"
+        "});\n"
+        "register(\"timeout\", async (port) => {\n"
+        "    expect(await rejection(\"http://127.0.0.1:\" + port + \"/\")\n"
+        "           === \"timeout http-timeout\", \"timeout\");\n"
+        "    return 1;\n"
+        "});\n");
+
+    js::Core core;
+    CHECK(core.add_file(script.path()) == 0);
+    int settled = 0;
+    CHECK(core.search("fail", "", expect_ok(settled)) == 0);
+    CHECK(core.search("refused", "", expect_ok(settled)) == 0);
+    CHECK(core.search("timeout", std::to_string(port), expect_ok(settled)) ==
+          0);
+    CHECK(core.loop_all() == 0);
+    CHECK(settled == 3);
+    // rejected http requests are not counted: the engines caught them
+    CHECK(core.error_counts().empty());
+    close(listener);
+}
+
+// failed searches are counted per runtime, engine and category
+static void test_error_counts() {
+    TestScript script(
+        "error_test",
+        "import { register } from \"searxpp:engine\";\n"
+        "import { fail } from \"searxpp:error\";\n"
+        "register(\"parse\", async (q) => {\n"
+        "    throw fail(\"parse\", \"bad-\" + q, \"oops\");\n"
+        "});\n"
+        "register(\"script\", () => { throw new Error(\"sync\"); });\n");
+
+    js::Core a, b;
+    CHECK(a.add_file(script.path()) == 0);
+    CHECK(b.add_file(script.path()) == 0);
+    int failed = 0;
+    auto expect_fail = [&](bool ok, std::string) {
+        CHECK(!ok);
+        failed++;
+    };
+    for (int i = 0; i < 3; i++)
+        CHECK(a.search("parse", std::to_string(i), expect_fail) == 0);
+    CHECK(a.search("script", "", expect_fail) == 0);
+    CHECK(b.search("script", "", expect_fail) == 0);
+    CHECK(js::Core::loop_all({&a, &b}) == 0);
+    CHECK(failed == 5);
+
+    auto counts = a.error_counts();
+    CHECK(counts.size() == 2);
+    for (auto &count : counts) {
+        if (count.engine == "parse")
+            CHECK(count.category == js::ErrorCategory::parse &&
+                  count.count == 3);
+        else
+            CHECK(count.engine == "script" &&
+                  count.category == js::ErrorCategory::script &&
+                  count.count == 1);
+    }
+    counts = b.error_counts();
+    CHECK(counts.size() == 1 && counts[0].engine == "script" &&
+          counts[0].count == 1);
+    // both runtimes log the engines under the same ids
+    CHECK(js::engine_log_id("parse") == js::engine_log_id("parse"));
+    CHECK(js::engine_log_id("parse") != js::engine_log_id("script"));
+    CHECK(js::engine_log_id("parse") < util::log::max_engines);
+}
+
+int main() {
+    js::register_builtin_modules();
+    test_native_error();
+    test_script_errors();
+    test_error_counts();
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "check.hpp"
+#include "js/gc.hpp"
+
+#include <cstring>
+
+using namespace lany;
+
+namespace {
+
+// cycles that only a collection can free
+void make_garbage(JSContext *ctx) {
+    const char *src = "for (let i = 0; i < 2000; i++) {\n"
+                      "    const a = {}, b = { a };\n"
+                      "    a.b = b;\n"
+                      "}\n";
+    JSValue ret =
+        JS_Eval(ctx, src, std::strlen(src), "<gc>", JS_EVAL_TYPE_GLOBAL);
+    CHECK(!JS_IsException(ret));
+    JS_FreeValue(ctx, ret);
+}
+
+} // namespace
+
+// runtimes with the tracking allocator are measured on every idle()
+static void test_tracked() {
+    js::GcManager::Options opts;
+    opts.idle_ratio = 0;
+    opts.measure_interval = std::chrono::hours(1);
+    js::GcManager gc(opts);
+    JSRuntime *rt = JS_NewRuntime2(&js::GcManager::malloc_functions, &gc);
+    JSContext *ctx = JS_NewContext(rt);
+    gc.attach(rt);
+    CHECK(gc.allocated() > 0);
+
+    make_garbage(ctx);
+    CHECK(gc.idle());
+    make_garbage(ctx);
+    CHECK(gc.idle());
+    CHECK(gc.stats().idle_runs == 2);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+}
+
+// runtimes without it are walked at most once per measure_interval
+static void test_fallback_rate_limit() {
+    js::GcManager::Options opts;
+    opts.idle_ratio = 0;
+    opts.measure_interval = std::chrono::hours(1);
+    js::GcManager gc(opts);
+    JSRuntime *rt = JS_NewRuntime();
+    JSContext *ctx = JS_NewContext(rt);
+    gc.attach(rt);
+    CHECK(gc.allocated() == 0);
+
+    make_garbage(ctx);
+    CHECK(gc.idle());
+    make_garbage(ctx);
+    CHECK(!gc.idle());
+    CHECK(!gc.idle());
+    CHECK(gc.stats().idle_runs == 1);
+    CHECK(gc.stats().skipped == 2);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+
+    opts.measure_interval = std::chrono::milliseconds(0);
+    js::GcManager every(opts);
+    rt = JS_NewRuntime();
+    ctx = JS_NewContext(rt);
+    every.attach(rt);
+    make_garbage(ctx);
+    CHECK(every.idle());
+    make_garbage(ctx);
+    CHECK(every.idle());
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+}
+
+int main() {
+    test_tracked();
+    test_fallback_rate_limit();
+    return 0;
+}
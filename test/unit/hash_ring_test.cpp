@@ -0,0 +1,64 @@
+#include "check.hpp"
+#include "util/hash_ring.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace lany::util;
+
+static void test_stable_lookup() {
+    hash_ring a, b;
+    for (uint32_t node = 0; node < 4; node++) {
+        a.add(node);
+        b.add(3 - node);
+    }
+    // placement depends only on the node set, not on insertion order
+    for (int i = 0; i < 1000; i++) {
+        std::string key = "key" + std::to_string(i);
+        CHECK(a.lookup(key) == b.lookup(key));
+        CHECK(a.lookup(key) >= 0 && a.lookup(key) < 4);
+    }
+}
+
+static void test_remove_moves_only_its_keys() {
+    hash_ring ring;
+    for (uint32_t node = 0; node < 4; node++)
+        ring.add(node);
+    std::vector<int64_t> before;
+    for (int i = 0; i < 1000; i++)
+        before.push_back(ring.lookup("key" + std::to_string(i)));
+
+    ring.remove(2);
+    int moved = 0;
+    for (int i = 0; i < 1000; i++) {
+        int64_t node = ring.lookup("key" + std::to_string(i));
+        CHECK(node != 2);
+        if (before[i] != 2)
+            CHECK(node == before[i]);
+        else
+            moved++;
+    }
+    // every node owns a fair share of the ring
+    CHECK(moved > 100 && moved < 400);
+}
+
+static void test_accept() {
+    hash_ring ring;
+    CHECK(ring.empty());
+    CHECK(ring.lookup("x") == -1);
+    ring.add(0);
+    ring.add(1);
+    CHECK(!ring.empty());
+    for (int i = 0; i < 100; i++) {
+        std::string key = std::to_string(i);
+        CHECK(ring.lookup(key, [](uint32_t node) { return node == 1; }) == 1);
+    }
+    CHECK(ring.lookup("x", [](uint32_t) { return false; }) == -1);
+}
+
+int main() {
+    test_stable_lookup();
+    test_remove_moves_only_its_keys();
+    test_accept();
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "check.hpp"
+#include "store/history.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+using namespace lany::store;
+namespace fs = std::filesystem;
+
+namespace {
+
+fs::path temp_dir() {
+    char tmpl[] = "/tmp/history_test.XXXXXX";
+    CHECK(mkdtemp(tmpl));
+    return tmpl;
+}
+
+std::vector<Record> scan_all(const HistoryReader &reader) {
+    std::vector<Record> ret;
+    reader.scan(0, UINT64_MAX, [&](const Record &record) {
+        ret.push_back(record);
+        return true;
+    });
+    return ret;
+}
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace
+
+static void test_append_and_scan() {
+    fs::path dir = temp_dir();
+    {
+        HistoryWriter writer(dir);
+        writer.log_query(1, "hello world");
+        writer.log_latency(1, 7, 1500, 0);
+        writer.log_result(1, 7, 0, fingerprint("https://example.com/"));
+        CHECK(writer.flush() == 0);
+    }
+    HistoryReader reader(dir);
+    CHECK(reader.segment_count() == 1);
+    auto records = scan_all(reader);
+    CHECK(records.size() == 3);
+
+    QueryRecord query;
+    CHECK(records[0].get(query));
+    CHECK(query.query_id == 1 && query.text == "hello world");
+    LatencyRecord latency;
+    CHECK(!records[0].get(latency));
+    CHECK(records[1].get(latency));
+    CHECK(latency.engine == 7 && latency.latency_us == 1500 &&
+          latency.status == 0);
+    ResultRecord result;
+    CHECK(records[2].get(result));
+    CHECK(result.position == 0 &&
+          result.fingerprint == fingerprint("https://example.com/"));
+    CHECK(records[0].timestamp < records[1].timestamp &&
+          records[1].timestamp < records[2].timestamp);
+
+    // time range
+    int count = 0;
+    reader.scan(records[1].timestamp, records[2].timestamp,
+                [&](const Record &) {
+                    count++;
+                    return true;
+                });
+    CHECK(count == 1);
+    fs::remove_all(dir);
+}
+
+static void test_rollover() {
+    fs::path dir = temp_dir();
+    HistoryWriter::Options opts;
+    opts.segment_size = 4096;
+    opts.index_interval = 512;
+    {
+        HistoryWriter writer(dir, opts);
+        for (uint64_t i = 0; i < 1000; i++) {
+            writer.log_query(i, "query " + std::to_string(i));
+            // exercise several batches as well
+            if (i % 300 == 0)
+                CHECK(writer.flush() == 0);
+        }
+        CHECK(writer.flush() == 0);
+    }
+    HistoryReader reader(dir);
+    CHECK(reader.segment_count() > 5);
+    auto records = scan_all(reader);
+    CHECK(records.size() == 1000);
+    for (uint64_t i = 0; i < records.size(); i++) {
+        QueryRecord query;
+        CHECK(records[i].get(query));
+        CHECK(query.query_id == i &&
+              query.text == "query " + std::to_string(i));
+        if (i > 0)
+            CHECK(records[i].timestamp > records[i - 1].timestamp);
+    }
+
+    // a range in the middle starts from the index, not the first segment
+    uint64_t from = records[500].timestamp, to = records[510].timestamp;
+    std::vector<uint64_t> ids;
+    reader.scan(from, to, [&](const Record &record) {
+        QueryRecord query;
+        CHECK(record.get(query));
+        ids.push_back(query.query_id);
+        return true;
+    });
+    CHECK(ids.size() == 10 && ids.front() == 500 && ids.back() == 509);
+    fs::remove_all(dir);
+}
+
+static void test_reopen() {
+    fs::path dir = temp_dir();
+    // a segment whose last record lies in the future, as after the clock
+    // was set back
+    uint64_t future = now_ns() + 3600ull * 1000000000;
+    {
+        std::ofstream seg(dir / "0000000000000000.seg", std::ios::binary);
+        uint64_t first = future - 1;
+        seg.write("SXPPHIS1", 8);
+        seg.write(reinterpret_cast<const char *>(&first), 8);
+        for (uint64_t ts : {first, future}) {
+            uint32_t size = 24;
+            uint16_t type = 1, padding = 0;
+            uint64_t query_id = ts;
+            seg.write(reinterpret_cast<const char *>(&size), 4);
+            seg.write(reinterpret_cast<const char *>(&type), 2);
+            seg.write(reinterpret_cast<const char *>(&padding), 2);
+            seg.write(reinterpret_cast<const char *>(&ts), 8);
+            seg.write(reinterpret_cast<const char *>(&query_id), 8);
+        }
+        // a torn record at the end is ignored
+        seg.write("\x40\0\0\0", 4);
+    }
+    {
+        HistoryWriter writer(dir);
+        writer.log_query(99, "after restart");
+        CHECK(writer.flush() == 0);
+    }
+    HistoryReader reader(dir);
+    CHECK(reader.segment_count() == 2);
+    auto records = scan_all(reader);
+    CHECK(records.size() == 3);
+    CHECK(records[1].timestamp == future);
+    CHECK(records[2].timestamp > future);
+    QueryRecord query;
+    CHECK(records[2].get(query) && query.query_id == 99);
+    fs::remove_all(dir);
+}
+
+int main() {
+    test_append_and_scan();
+    test_rollover();
+    test_reopen();
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include "check.hpp"
+#include "util/decoder.hpp"
+#include "util/http_client.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <string>
+#include <thread>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace lany::util;
+
+namespace {
+
+std::string gzip(const std::string &in) {
+    z_stream zs{};
+    CHECK(deflateInit2(&zs, 6, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) ==
+          Z_OK);
+    std::string out(deflateBound(&zs, in.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef *>(out.data());
+    zs.avail_out = static_cast<uInt>(out.size());
+    CHECK(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+// Answers `count` connections on 127.0.0.1 with `response` and records the
+// request heads. Without `wait_for_head` it answers after the first read.
+// With `piece` set the response is sent that many bytes at a time.
+class server {
+    int fd;
+    std::thread thread;
+
+public:
+    uint16_t port;
+    std::vector<std::string> heads;
+
+    server(std::string response, int count = 1, bool wait_for_head = true,
+           size_t piece = 0) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        CHECK(fd >= 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        CHECK(bind(fd, reinterpret_cast<sockaddr *>(&addr), len) == 0);
+        CHECK(listen(fd, 16) == 0);
+        CHECK(getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) ==
+              0);
+        port = ntohs(addr.sin_port);
+        if (!piece)
+            piece = response.size();
+        thread = std::thread([this, response, count, wait_for_head, piece] {
+            for (int i = 0; i < count; i++) {
+                int conn = accept(fd, nullptr, nullptr);
+                CHECK(conn >= 0);
+                std::string head;
+                char buf[4096];
+                ssize_t n;
+                while ((n = recv(conn, buf, sizeof(buf), 0)) > 0) {
+                    head.append(buf, n);
+                    if (!wait_for_head ||
+                        head.find("\r\n\r\n") != std::string::npos)
+                        break;
+                }
+                heads.push_back(head);
+                for (size_t pos = 0; pos < response.size(); pos += piece) {
+                    size_t len = std::min(piece, response.size() - pos);
+                    CHECK(send(conn, response.data() + pos, len,
+                               MSG_NOSIGNAL) == ssize_t(len));
+                    if (pos + len < response.size())
+                        std::this_thread::sleep_for(
+                            std::chrono::milliseconds(1));
+                }
+                close(conn);
+            }
+        });
+    }
+    ~server() {
+        thread.join();
+        close(fd);
+    }
+};
+
+http_response get(http_client &client, const std::string &url,
+                  replay_key key = {}) {
+    std::promise<http_response> done;
+    auto res = done.get_future();
+    client.get(
+        url, std::chrono::seconds(5),
+        [&](http_response r) { done.set_value(std::move(r)); }, key);
+    return res.get();
+}
+
+std::string response(const std::string &headers, const std::string &body) {
+    return "HTTP/1.1 200 OK\r\n" + headers +
+           "Content-Length: " + std::to_string(body.size()) +
+           "\r\nConnection: close\r\n\r\n" + body;
+}
+
+} // namespace
+
+// bytes that are not valid UTF-8 come back unchanged after decoding
+static void test_gzip_binary_body() {
+    std::string body("\x00\xff\xfe binary \x80\x00", 14);
+    for (int i = 0; i < 10; i++)
+        body += body;
+    server srv(response("Content-Encoding: gzip\r\n", gzip(body)));
+    http_client client;
+    // goes through the resolver rather than the numeric fast path
+    auto res = get(client, "http://localhost:" + std::to_string(srv.port) +
+                               "/search?q=x");
+    CHECK(res.error.empty());
+    CHECK(res.status == 200);
+    CHECK(res.body == body);
+    CHECK(srv.heads[0].starts_with("GET /search?q=x HTTP/1.1\r\n"));
+    CHECK(srv.heads[0].find(std::string("\r\nAccept-Encoding: ") +
+                            accept_encoding + "\r\n") != std::string::npos);
+}
+
+static void test_corrupt_encoding() {
+    server srv(response("Content-Encoding: gzip\r\n", "not gzip"));
+    http_client client;
+    auto res = get(client, "http://127.0.0.1:" + std::to_string(srv.port));
+    CHECK(!res.error.empty());
+    CHECK(!res.timed_out);
+}
+
+// a response trickling in a few bytes at a time, split inside the head
+// terminator, chunk headers and chunk data
+static void test_chunked_pieces() {
+    std::string body;
+    std::string chunks;
+    for (int i = 1; i <= 20; i++) {
+        std::string chunk(i * 7, static_cast<char>('a' + i));
+        char size[16];
+        std::snprintf(size, sizeof(size), "%zx", chunk.size());
+        chunks += std::string(size) + "\r\n" + chunk + "\r\n";
+        body += chunk;
+    }
+    server srv("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n"
+               "Connection: close\r\n\r\n" +
+                   chunks + "0\r\n\r\n",
+               1, true, 5);
+    http_client client;
+    auto res = get(client, "http://127.0.0.1:" + std::to_string(srv.port));
+    CHECK(res.error.empty());
+    CHECK(res.status == 200);
+    CHECK(res.body == body);
+}
+
+// redirected requests carry the replay key they were made with
+static void test_redirect_key() {
+    server srv(response("", "ok"), 2);
+    http_client client;
+    client.redirect("127.0.0.1", srv.port);
+    CHECK(get(client, "https://example.com/a", {7, 2}).body == "ok");
+    CHECK(get(client, "http://example.com/b").body == "ok");
+    CHECK(srv.heads[0].starts_with("GET /example.com/a HTTP/1.1\r\n"));
+    CHECK(srv.heads[0].find("\r\nX-Replay-Key: 7.2\r\n") !=
+          std::string::npos);
+    CHECK(srv.heads[1].starts_with("GET /example.com/b HTTP/1.1\r\n"));
+    CHECK(srv.heads[1].find("X-Replay-Key") == std::string::npos);
+}
+
+// a plain http server is not a TLS peer
+static void test_tls_handshake_failure() {
+    server srv("HTTP/1.1 200 OK\r\n\r\n", 1, false);
+    http_client client;
+    auto res = get(client, "https://127.0.0.1:" + std::to_string(srv.port));
+    CHECK(!res.error.empty());
+    CHECK(!res.timed_out);
+}
+
+int main() {
+    test_gzip_binary_body();
+    test_corrupt_encoding();
+    test_chunked_pieces();
+    test_redirect_key();
+    test_tls_handshake_failure();
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "check.hpp"
+#include "util/log.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+using namespace lany::util;
+
+int main() {
+    char path[] = "/tmp/log_test.XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+    CHECK(log::open_binary(path) == 0);
+
+    std::string long_msg(5000, 'x');
+    long_msg += "end";
+    std::string huge(100000, 'y');
+    log::log(log::info, log::no_engine, "short {}", 1);
+    log::log(log::info, 7, "long {}", long_msg);
+    log::log(log::error, log::no_engine, "{}", huge);
+    log::flush();
+
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream out;
+    CHECK(log::decode(in, out) == 0);
+    std::string text = out.str();
+    std::istringstream lines(text);
+    std::string line;
+
+    CHECK(std::getline(lines, line));
+    CHECK(line.find("[info] [thread ") != std::string::npos);
+    CHECK(line.substr(line.size() - 7) == "short 1");
+
+    // records longer than a slot are kept whole
+    CHECK(std::getline(lines, line));
+    CHECK(line.find("[engine 7] long " + long_msg) != std::string::npos);
+    CHECK(line.substr(line.size() - 3) == "end");
+
+    // up to the spill limit
+    CHECK(std::getline(lines, line));
+    CHECK(line.find("[error]") != std::string::npos);
+    CHECK(line.find(std::string(log::max_spilled_message, 'y')) !=
+          std::string::npos);
+    CHECK(line.find(std::string(log::max_spilled_message + 1, 'y')) ==
+          std::string::npos);
+    CHECK(!std::getline(lines, line));
+
+    std::istringstream garbage("not a log");
+    CHECK(log::decode(garbage, out) < 0);
+    std::remove(path);
+    return 0;
+}
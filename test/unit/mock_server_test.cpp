@@ -0,0 +1,111 @@
+#include "check.hpp"
+#include "mock_server.hpp"
+#include "util/http_client.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+
+#include <stdlib.h>
+
+using namespace lany;
+namespace fs = std::filesystem;
+
+namespace {
+
+fs::path temp_dir() {
+    char tmpl[] = "/tmp/mock_server_test.XXXXXX";
+    CHECK(mkdtemp(tmpl));
+    return tmpl;
+}
+
+util::http_response get(util::http_client &client, const std::string &url,
+                        util::replay_key key = {}) {
+    std::promise<util::http_response> done;
+    auto res = done.get_future();
+    client.get(
+        url, std::chrono::seconds(5),
+        [&](util::http_response r) { done.set_value(std::move(r)); }, key);
+    return res.get();
+}
+
+bench::mock_server::options upstream(uint64_t seed, double error_rate) {
+    bench::mock_server::options opts;
+    opts.seed = seed;
+    opts.latency_ms = 1;
+    opts.jitter_ms = 2;
+    opts.error_rate = error_rate;
+    return opts;
+}
+
+} // namespace
+
+// the same seed and key give the same delay and error
+static void test_plan() {
+    bench::mock_server a(upstream(42, 0.3)), b(upstream(42, 0.3));
+    bench::mock_server other(upstream(43, 0.3));
+    int errors = 0, differ = 0, keyed = 0;
+    for (int64_t search = -1; search < 50; search++) {
+        for (uint32_t fetch = 0; fetch < 4; fetch++) {
+            util::replay_key key{search, fetch};
+            auto p = a.plan_for("/example.com/search?q=x", key);
+            auto q = b.plan_for("/example.com/search?q=x", key);
+            CHECK(p.delay_ms == q.delay_ms && p.error == q.error);
+            CHECK(p.delay_ms >= 1);
+            errors += p.error;
+            auto r = other.plan_for("/example.com/search?q=x", key);
+            differ += r.delay_ms != p.delay_ms;
+            keyed += a.plan_for("/example.com/search?q=x", {search, 9})
+                         .delay_ms != p.delay_ms;
+        }
+    }
+    // 204 draws at a 30% error rate
+    CHECK(errors > 20 && errors < 110);
+    CHECK(differ > 190 && keyed > 190);
+}
+
+// answers over the wire follow the plan; unknown paths are 404s
+static void test_replay() {
+    auto dir = temp_dir();
+    fs::create_directories(dir / "example.com");
+    std::ofstream(dir / "example.com" / "search.json") << "{\"results\":[]}";
+
+    bench::mock_server srv(upstream(7, 0.5));
+    CHECK(srv.load(dir.string()) == 1);
+    CHECK(srv.start() == 0);
+    util::http_client client;
+    client.redirect("127.0.0.1", srv.port());
+
+    int ok = 0;
+    for (int64_t search = 0; search < 16; search++) {
+        util::replay_key key{search, 1};
+        auto res = get(client, "https://example.com/search?q=x", key);
+        CHECK(res.error.empty());
+        bool error = srv.plan_for("/example.com/search?q=x", key).error;
+        CHECK(res.status == (error ? 503 : 200));
+        if (!error) {
+            CHECK(res.body == "{\"results\":[]}");
+            ok++;
+        }
+    }
+    CHECK(ok > 0 && ok < 16);
+
+    // a key the plan answers without an error
+    util::replay_key key{0, 0};
+    while (srv.plan_for("/example.com/missing", key).error)
+        key.search++;
+    auto res = get(client, "http://example.com/missing", key);
+    CHECK(res.error.empty() && res.status == 404);
+    auto stats = srv.get_stats();
+    CHECK(stats.requests == 17 && stats.misses == 1);
+    CHECK(stats.errors == uint64_t(16 - ok));
+    srv.stop();
+    fs::remove_all(dir);
+}
+
+int main() {
+    test_plan();
+    test_replay();
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "check.hpp"
+#include "js/prefetch.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace lany::js;
+
+using names = std::vector<std::string>;
+
+static void test_static_imports() {
+    auto imports = scan_imports(
+        "import a from \"./a.js\";\n"
+        "import { x, y as z } from './b.js'\n"
+        "import * as ns from \"searxpp:http\";\n"
+        "import \"./side.js\";\n"
+        "import def, { w } from\n"
+        "    /* spread over lines */ \"./c.js\";\n"
+        "export { q } from \"./re.js\";\n"
+        "export * from './all.js';\n"
+        "export * as all from './ns.js';\n");
+    CHECK((imports == names{"./a.js", "./b.js", "searxpp:http", "./side.js",
+                            "./c.js", "./re.js", "./all.js", "./ns.js"}));
+}
+
+// only dynamic imports of a plain literal are known before running
+static void test_dynamic_imports() {
+    CHECK((scan_imports("const m = await import(\"./dyn.js\");") ==
+           names{"./dyn.js"}));
+    CHECK(scan_imports("import(name); import(`./t${x}.js`);\n"
+                       "import(\"./a\" + b);")
+              .empty());
+}
+
+// lookalikes in comments, strings, members and other statements
+static void test_not_imports() {
+    CHECK(scan_imports("// import \"line.js\"\n"
+                       "/* import \"block.js\" */\n"
+                       "const s = \"import 'string.js'\";\n"
+                       "const t = `export * from \"template.js\"`;\n"
+                       "loader.import(\"member.js\");\n"
+                       "const url = import.meta.url;\n"
+                       "export const from = \"value.js\";\n"
+                       "export default function () { return 1; }\n"
+                       "const important = 1, exports = {};\n")
+              .empty());
+    // an unterminated comment or string ends the scan quietly
+    CHECK(scan_imports("/* import \"a.js\"").empty());
+    CHECK(scan_imports("\"import 'a.js'").empty());
+    CHECK((scan_imports("import { a } from") == names{}));
+}
+
+static void test_normalize() {
+    CHECK(normalize_module_name("dir/main.js", "./a.js") == "dir/a.js");
+    CHECK(normalize_module_name("dir/sub/m.js", "../b.js") == "dir/b.js");
+    CHECK(normalize_module_name("a/b/c.js", "./.././d.js") == "a/d.js");
+    CHECK(normalize_module_name("main.js", "./a.js") == "a.js");
+    // bare specifiers are left to the loader
+    CHECK(normalize_module_name("dir/m.js", "searxpp:http") ==
+          "searxpp:http");
+    // nothing left to climb out of
+    CHECK(normalize_module_name("m.js", "../up.js") == "../up.js");
+    CHECK(normalize_module_name("../m.js", "../up.js") == "../../up.js");
+}
+
+int main() {
+    test_static_imports();
+    test_dynamic_imports();
+    test_not_imports();
+    test_normalize();
+    return 0;
+}
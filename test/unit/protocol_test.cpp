@@ -0,0 +1,112 @@
+#include "check.hpp"
+#include "ipc/protocol.hpp"
+
+#include <algorithm>
+#include <string>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace lany::ipc;
+
+static void test_payload() {
+    std::string buf;
+    PayloadWriter writer(buf);
+    writer.put_u32(2);
+    writer.put_str("engine");
+    writer.put_str(std::string("a\0b", 3));
+
+    PayloadReader reader(buf);
+    uint32_t count;
+    std::string_view a, b;
+    CHECK(reader.get_u32(count) && count == 2);
+    CHECK(reader.get_str(a) && a == "engine");
+    CHECK(reader.get_str(b) && b == std::string_view("a\0b", 3));
+    CHECK(!reader.get_str(a));
+
+    // a length running past the end is rejected
+    std::string bad;
+    PayloadWriter(bad).put_u32(100);
+    PayloadReader truncated(bad);
+    CHECK(!truncated.get_str(a));
+}
+
+static void test_partial_frames() {
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    Frame out{FrameType::query};
+    out.id = 42;
+    out.flags = flag_ok;
+    out.payload.assign(100000, 'x');
+    std::string wire;
+    {
+        // capture the encoded frame to feed it back in pieces
+        int pair[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+        CHECK(send_frame(pair[0], out) == 0);
+        close(pair[0]);
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(pair[1], buf, sizeof(buf))) > 0)
+            wire.append(buf, n);
+        close(pair[1]);
+    }
+    CHECK(wire.size() == 16 + out.payload.size());
+
+    FrameReader reader;
+    Frame in;
+    CHECK(reader.fill(fds[1]) == 0);
+    CHECK(reader.next(in) == 0);
+    // one byte, then the rest: nothing blocks and the frame completes once
+    CHECK(write(fds[0], wire.data(), 1) == 1);
+    CHECK(reader.fill(fds[1]) == 0);
+    CHECK(reader.next(in) == 0);
+    size_t off = 1;
+    while (off < wire.size()) {
+        ssize_t n = write(fds[0], wire.data() + off,
+                          std::min<size_t>(8192, wire.size() - off));
+        CHECK(n > 0);
+        off += n;
+        CHECK(reader.fill(fds[1]) == 0);
+    }
+    CHECK(reader.next(in) == 1);
+    CHECK(in.type == FrameType::query && in.id == 42 && in.flags == flag_ok);
+    CHECK(in.payload == out.payload);
+    CHECK(reader.next(in) == 0);
+
+    // two frames in one read, then an orderly close
+    Frame small{FrameType::shutdown};
+    CHECK(send_frame(fds[0], small) == 0);
+    CHECK(send_frame(fds[0], small) == 0);
+    close(fds[0]);
+    CHECK(reader.wait(fds[1], in, 1000) == 1);
+    CHECK(in.type == FrameType::shutdown);
+    CHECK(reader.next(in) == 1);
+    CHECK(reader.fill(fds[1]) < 0);
+    close(fds[1]);
+}
+
+static void test_dead_peer() {
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    close(fds[1]);
+    // must fail instead of killing the process with SIGPIPE
+    Frame frame{FrameType::query};
+    CHECK(send_frame(fds[0], frame) < 0);
+    close(fds[0]);
+
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    FrameReader reader;
+    Frame in;
+    CHECK(reader.wait(fds[1], in, 10) == 0);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main() {
+    test_payload();
+    test_partial_frames();
+    test_dead_peer();
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "check.hpp"
+#include "js/builtins.hpp"
+#include "js/jsc.hpp"
+#include "js/result_batch.hpp"
+#include "script.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace lany;
+
+namespace {
+
+struct Ranked {
+    std::string url, title, content;
+    double score;
+    uint32_t engine, position;
+
+    bool operator==(const Ranked &) const = default;
+};
+
+std::vector<Ranked> read_ranked(const std::string &payload) {
+    JSRuntime *rt = JS_NewRuntime();
+    JSContext *ctx = JS_NewContext(rt);
+    JSValue val = JS_ReadObject(
+        ctx, reinterpret_cast<const uint8_t *>(payload.data()),
+        payload.size(), 0);
+    CHECK(!JS_IsException(val));
+    js::RankedColumns cols;
+    CHECK(js::read_ranked_batch(ctx, val, cols));
+    std::vector<Ranked> ret;
+    for (uint32_t i = 0; i < cols.size; i++)
+        ret.push_back({std::string(cols.string(i, 0)),
+                       std::string(cols.string(i, 1)),
+                       std::string(cols.string(i, 2)), cols.scores[i],
+                       cols.engines[i], cols.positions[i]});
+    JS_FreeValue(ctx, val);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+    return ret;
+}
+
+} // namespace
+
+int main() {
+    js::register_builtin_modules();
+    TestScript script(
+        "result_batch_test",
+        "import { register } from \"searxpp:engine\";\n"
+        "import { createBatch } from \"searxpp:result\";\n"
+        "register(\"ranked\", () => {\n"
+        "    const batch = createBatch();\n"
+        "    batch.push(1, 2, 0, \"u0\", \"t0\", \"c0\");\n"
+        "    batch.push(3, 2, 5, \"u1\", \"t1\", \"c1\");\n"
+        "    batch.push(3, 4, 1, \"u2\", \"t2\");\n"
+        "    return batch;\n"
+        "});\n"
+        // views taken before the batch grows keep their old contents
+        "register(\"grow\", () => {\n"
+        "    const batch = createBatch();\n"
+        "    batch.push(0.5, 1, 0, \"first\");\n"
+        "    const scores = batch.scores, offsets = batch.offsets;\n"
+        "    expect(batch.scores === scores, \"cached view\");\n"
+        "    for (let i = 1; i < 1000; i++)\n"
+        "        batch.push(i, 1, i, \"url \" + i);\n"
+        "    expect(scores.length === 1 && scores[0] === 0.5, \"old\");\n"
+        "    expect(offsets.length === 4 && offsets[1] === 5, \"offsets\");\n"
+        "    const grown = batch.scores;\n"
+        "    expect(grown !== scores && grown.length === 1000, \"new\");\n"
+        "    expect(grown[0] === 0.5 && grown[999] === 999, \"copied\");\n"
+        "    expect(batch.url(999) === \"url 999\", \"url\");\n"
+        "    batch.clear();\n"
+        "    expect(batch.length === 0 && grown[999] === 999, \"clear\");\n"
+        "    return 1;\n"
+        "});\n"
+        // views outlive the batch they came from
+        "register(\"lifetime\", () => {\n"
+        "    const views = (() => {\n"
+        "        const batch = createBatch();\n"
+        "        batch.push(7, 3, 0, \"u\", \"title\", \"content\");\n"
+        "        return [batch.scores, batch.strings, batch.offsets];\n"
+        "    })();\n"
+        "    for (let i = 0; i < 100; i++)\n"
+        "        createBatch().push(i, i, i, \"x\".repeat(100));\n"
+        "    const [scores, strings, offsets] = views;\n"
+        "    expect(scores[0] === 7, \"scores\");\n"
+        "    const title = strings.subarray(offsets[1], offsets[2]);\n"
+        "    expect(String.fromCharCode(...title) === \"title\", \"title\");\n"
+        "    return 1;\n"
+        "});\n"
+        // scores that cannot be ranked are refused
+        "register(\"nan\", () => {\n"
+        "    const batch = createBatch();\n"
+        "    for (const score of [undefined, NaN, Infinity]) {\n"
+        "        try {\n"
+        "            batch.push(score, 1, 0, \"u\");\n"
+        "        } catch (e) {\n"
+        "            expect(e instanceof TypeError, String(score));\n"
+        "            continue;\n"
+        "        }\n"
+        "        throw new Error(\"accepted \" + score);\n"
+        "    }\n"
+        "    expect(batch.length === 0, \"nothing pushed\");\n"
+        "    return 1;\n"
+        "});\n");
+
+    js::Core core;
+    CHECK(core.add_file(script.path()) == 0);
+    CHECK(core.loop_all() == 0);
+    std::string ranked;
+    int settled = 0;
+    CHECK(core.search("ranked", "", expect_ok(settled, &ranked)) == 0);
+    CHECK(core.search("grow", "", expect_ok(settled)) == 0);
+    CHECK(core.search("lifetime", "", expect_ok(settled)) == 0);
+    CHECK(core.search("nan", "", expect_ok(settled)) == 0);
+    CHECK(core.loop_all() == 0);
+    CHECK(settled == 4);
+    // ties on score are broken by position
+    CHECK((read_ranked(ranked) == std::vector<Ranked>{
+                                      {"u2", "t2", "", 3, 4, 1},
+                                      {"u1", "t1", "c1", 3, 2, 5},
+                                      {"u0", "t0", "c0", 1, 2, 0},
+                                  }));
+    return 0;
+}
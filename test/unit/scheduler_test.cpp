@@ -0,0 +1,82 @@
+#include "check.hpp"
+#include "js/scheduler.hpp"
+
+#include <chrono>
+
+using namespace lany::js;
+using namespace std::chrono_literals;
+
+namespace {
+
+// the scheduler only uses contexts as keys
+JSContext *fake_ctx(uintptr_t n) { return reinterpret_cast<JSContext *>(n); }
+
+} // namespace
+
+static void test_quota() {
+    Scheduler sched(Scheduler::Options{8, 1000000us});
+    JSContext *a = fake_ctx(1), *b = fake_ctx(2);
+    sched.add(a, 3);
+    sched.add(b, 1);
+
+    // a gets 6 of the 8 jobs of a slice
+    sched.begin_slice();
+    auto now = Scheduler::clock::now();
+    for (int i = 0; i < 5; i++) {
+        sched.account(a, now, now);
+        CHECK(sched.has_budget());
+    }
+    sched.account(a, now, now);
+    CHECK(!sched.has_budget());
+    CHECK(sched.stats(a)->yields == 1);
+    CHECK(sched.stats(a)->slices == 1);
+    CHECK(sched.stats(a)->jobs == 6);
+
+    sched.begin_slice();
+    CHECK(sched.has_budget());
+    sched.account(b, now, now);
+    sched.account(b, now, now);
+    CHECK(!sched.has_budget());
+    CHECK(sched.stats(b)->yields == 1);
+
+    // alone, an entry point runs up to the slice limit
+    sched.remove(b);
+    CHECK(sched.stats(b) == nullptr);
+    sched.begin_slice();
+    for (int i = 0; i < 8; i++)
+        sched.account(a, now, now);
+    CHECK(sched.stats(a)->yields == 1);
+    CHECK(!sched.has_budget());
+}
+
+static void test_wait_from_enqueue() {
+    Scheduler sched;
+    JSContext *a = fake_ctx(1);
+    sched.add(a);
+    auto t0 = Scheduler::clock::now();
+
+    // an idle entry point does not accumulate wait
+    sched.enqueued(a, t0 + 10ms);
+    sched.begin_slice();
+    sched.account(a, t0 + 15ms, t0 + 16ms);
+    CHECK(sched.stats(a)->wait_time == 5ms);
+
+    // a job the script queued itself waits from the end of the previous one
+    sched.account(a, t0 + 20ms, t0 + 21ms);
+    CHECK(sched.stats(a)->wait_time == 9ms);
+    CHECK(sched.stats(a)->max_wait == 5ms);
+    CHECK(sched.stats(a)->jobs == 2);
+    CHECK(sched.stats(a)->slices == 1);
+
+    // a stamp older than the last job does not move the reference back
+    sched.enqueued(a, t0);
+    sched.account(a, t0 + 22ms, t0 + 22ms);
+    CHECK(sched.stats(a)->wait_time == 10ms);
+    CHECK(sched.stats(a)->run_time == 2ms);
+}
+
+int main() {
+    test_quota();
+    test_wait_from_enqueue();
+    return 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "check.hpp"
+#include "js/engine.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+// An engine script written to a fresh temporary file and removed again when
+// the fixture goes out of scope. The script may call `expect(cond, what)`,
+// which throws `what` unless `cond` holds.
+class TestScript {
+    std::string _path;
+
+public:
+    TestScript(const std::string &name, const std::string &source) {
+        std::string text = "const expect = (c, what) => {\n"
+                           "    if (!c) throw new Error(what);\n"
+                           "};\n" +
+                           source;
+        _path = "/tmp/" + name + ".XXXXXX.js";
+        int fd = mkstemps(_path.data(), 3);
+        CHECK(fd >= 0);
+        CHECK(write(fd, text.data(), text.size()) == ssize_t(text.size()));
+        close(fd);
+    }
+    TestScript(const TestScript &) = delete;
+    ~TestScript() { std::remove(_path.c_str()); }
+
+    const std::string &path() const { return _path; }
+};
+
+// A search callback that fails the test if the search is rejected, counts
+// it in `settled` and keeps its payload in `payload`, if given.
+inline lany::js::SearchCallback expect_ok(int &settled,
+                                          std::string *payload = nullptr) {
+    return [&settled, payload](bool ok, std::string result) {
+        if (!ok)
+            std::fprintf(stderr, "search failed: %s\n", result.c_str());
+        CHECK(ok);
+        settled++;
+        if (payload)
+            *payload = std::move(result);
+    };
+}
@@ -0,0 +1,162 @@
+#include "check.hpp"
+#include "ipc/shard.hpp"
+#include "js/builtins.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace lany;
+
+namespace {
+
+struct Result {
+    bool done = false;
+    bool ok = false;
+    std::string payload;
+};
+
+std::string write_script(const std::string &dir, const std::string &name,
+                         const std::string &source) {
+    std::string path = dir + "/" + name;
+    std::ofstream(path) << source;
+    return path;
+}
+
+pid_t spawn_shard(const std::string &script, const std::string &socket) {
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        ipc::ShardWorker worker;
+        int ret = worker.add_file(script) < 0 ? 1 : 0;
+        if (ret == 0)
+            ret = worker.run(socket) < 0 ? 1 : 0;
+        _exit(ret);
+    }
+    return pid;
+}
+
+ipc::Coordinator::ResultCallback collect(Result &res) {
+    return [&res](const std::string &, bool ok, std::string payload) {
+        res.done = true;
+        res.ok = ok;
+        res.payload = std::move(payload);
+    };
+}
+
+// Polls until no search is outstanding or the deadline passes.
+int settle(ipc::Coordinator &coordinator, int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeout_ms);
+    int left = 1;
+    while (left > 0 && std::chrono::steady_clock::now() < deadline)
+        left = coordinator.poll(50);
+    return left;
+}
+
+// Engines fail with the name of the shard serving them, which makes the
+// routing visible in the error message.
+bool served_by(const Result &res, const char *shard) {
+    return res.done && !res.ok &&
+           res.payload.find(std::string("served by ") + shard) !=
+               std::string::npos;
+}
+
+} // namespace
+
+int main() {
+    js::register_builtin_modules();
+
+    char tmpl[] = "/tmp/shard_test.XXXXXX";
+    CHECK(mkdtemp(tmpl));
+    std::string dir = tmpl;
+    std::string socket = dir + "/coordinator.sock";
+    std::string a = write_script(
+        dir, "a.js",
+        "import { register } from \"searxpp:engine\";\n"
+        "const fail = () => { throw new Error(\"served by A\"); };\n"
+        "register(\"alpha\", fail);\n"
+        "register(\"common\", fail);\n");
+    std::string b = write_script(
+        dir, "b.js",
+        "import { register } from \"searxpp:engine\";\n"
+        "const fail = () => { throw new Error(\"served by B\"); };\n"
+        "register(\"beta\", fail);\n"
+        "register(\"common\", fail);\n"
+        "register(\"stall\", () => new Promise(() => {}));\n");
+
+    ipc::Coordinator coordinator;
+    CHECK(coordinator.listen(socket) == 0);
+    // shards are accepted in order, so A is shard 0 and B is shard 1
+    pid_t pid_a = spawn_shard(a, socket);
+    CHECK(coordinator.accept_shard() == 0);
+    pid_t pid_b = spawn_shard(b, socket);
+    CHECK(coordinator.accept_shard() == 0);
+    CHECK(coordinator.engines().size() == 4);
+
+    // engines hosted by one shard only go there
+    Result alpha, beta;
+    CHECK(coordinator.route("alpha", "q", collect(alpha)) == 0);
+    CHECK(coordinator.route("beta", "q", collect(beta)) == 0);
+    CHECK(coordinator.route("missing", "q", collect(alpha)) == -1);
+    CHECK(settle(coordinator, 5000) == 0);
+    CHECK(served_by(alpha, "A"));
+    CHECK(served_by(beta, "B"));
+
+    // a shared engine is partitioned by query, and stably so
+    std::vector<Result> first(32), second(32);
+    for (int i = 0; i < 32; i++)
+        CHECK(coordinator.route("common", "q" + std::to_string(i),
+                                collect(first[i])) == 0);
+    CHECK(settle(coordinator, 5000) == 0);
+    for (int i = 0; i < 32; i++)
+        CHECK(coordinator.route("common", "q" + std::to_string(i),
+                                collect(second[i])) == 0);
+    CHECK(settle(coordinator, 5000) == 0);
+    int on_a = 0;
+    for (int i = 0; i < 32; i++) {
+        bool a_first = served_by(first[i], "A");
+        CHECK(a_first || served_by(first[i], "B"));
+        CHECK(a_first == served_by(second[i], "A"));
+        on_a += a_first;
+    }
+    CHECK(on_a > 0 && on_a < 32);
+
+    // killing a shard fails its outstanding searches and reroutes the rest
+    Result stall;
+    CHECK(coordinator.route("stall", "q", collect(stall)) == 0);
+    CHECK(coordinator.poll(100) == 1);
+    CHECK(!stall.done);
+    kill(pid_b, SIGKILL);
+    CHECK(waitpid(pid_b, nullptr, 0) == pid_b);
+    CHECK(settle(coordinator, 5000) == 0);
+    CHECK(stall.done && !stall.ok && stall.payload == "shard disconnected");
+
+    Result gone;
+    CHECK(coordinator.route("beta", "q", collect(gone)) == -1);
+    CHECK(coordinator.engines().size() == 2);
+    for (int i = 0; i < 32; i++) {
+        Result res;
+        CHECK(coordinator.route("common", "q" + std::to_string(i),
+                                collect(res)) == 0);
+        CHECK(settle(coordinator, 5000) == 0);
+        CHECK(served_by(res, "A"));
+    }
+
+    coordinator.shutdown();
+    int status;
+    CHECK(waitpid(pid_a, &status, 0) == pid_a);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    unlink(a.c_str());
+    unlink(b.c_str());
+    unlink(socket.c_str());
+    rmdir(dir.c_str());
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include "check.hpp"
+#include "util/utf8.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace lany::util;
+
+namespace {
+
+bool valid(const std::string &s) {
+    return validate_utf8(reinterpret_cast<const uint8_t *>(s.data()),
+                         s.size());
+}
+
+bool ascii(const std::string &s) {
+    return is_ascii(reinterpret_cast<const uint8_t *>(s.data()), s.size());
+}
+
+// `seq` preceded by `offset` ASCII bytes and followed by some more, so it
+// lands on every position relative to the 16 byte blocks of the fast path
+std::string at(size_t offset, const std::string &seq) {
+    return std::string(offset, 'a') + seq + std::string(20, 'b');
+}
+
+std::vector<std::string> words(const std::string &text) {
+    std::vector<token_span> tokens;
+    tokenize(text, tokens);
+    std::vector<std::string> ret;
+    for (auto [begin, end] : tokens)
+        ret.push_back(text.substr(begin, end - begin));
+    return ret;
+}
+
+} // namespace
+
+static void test_ascii() {
+    for (size_t len = 0; len < 70; len++) {
+        std::string s(len, 'x');
+        CHECK(ascii(s) && valid(s));
+        // a single high byte anywhere is found, including in the scalar tail
+        for (size_t i = 0; i < len; i++) {
+            std::string t = s;
+            t[i] = '\x80';
+            CHECK(!ascii(t));
+            CHECK(!valid(t));
+        }
+    }
+}
+
+static void test_valid_multibyte() {
+    const char *const seqs[] = {
+        "\xc2\x80",         "\xdf\xbf",         "\xe0\xa0\x80",
+        "\xed\x9f\xbf",     "\xef\xbf\xbf",     "\xf0\x90\x80\x80",
+        "\xf4\x8f\xbf\xbf", "\xc3\xa9t\xc3\xa9", "\xe2\x82\xac\xf0\x9f\x98\x80",
+    };
+    for (auto seq : seqs)
+        for (size_t offset = 0; offset < 34; offset++) {
+            CHECK(valid(at(offset, seq)));
+            CHECK(!ascii(at(offset, seq)));
+        }
+    // non-ASCII text long enough for the scalar path to hand back to SIMD
+    std::string mixed;
+    for (int i = 0; i < 50; i++)
+        mixed += "\xc3\xa4" + std::string(i % 19, 'z');
+    CHECK(valid(mixed));
+}
+
+static void test_invalid() {
+    const char *const seqs[] = {
+        "\x80",             // lone continuation byte
+        "\xbf",             //
+        "\xc0\xaf",         // overlong encodings
+        "\xc1\xbf",         //
+        "\xe0\x80\xaf",     //
+        "\xf0\x80\x80\xaf", //
+        "\xed\xa0\x80",     // surrogate
+        "\xf4\x90\x80\x80", // above U+10FFFF
+        "\xf5\x80\x80\x80", //
+        "\xff",             //
+        "\xc3",             // missing continuation bytes
+        "\xe2\x82",         //
+        "\xf0\x9f\x98",     //
+        "\xe2\x28\xa1",     // continuation byte expected
+        "\xf0\x9f\x28\x80", //
+    };
+    for (auto seq : seqs) {
+        for (size_t offset = 0; offset < 34; offset++)
+            CHECK(!valid(at(offset, seq)));
+        // cut off by the end of the input
+        CHECK(!valid(std::string(31, 'a') + seq));
+    }
+    CHECK(!valid(std::string("\xe2\x82\xac", 2)));
+}
+
+static void test_ascii_lower() {
+    std::string in;
+    for (int i = 0; i < 3; i++)
+        for (int c = 0; c < 256; c++)
+            in += static_cast<char>(c);
+    for (size_t len : {size_t(0), size_t(15), size_t(16), size_t(17),
+                       size_t(255), in.size()}) {
+        std::string out(len, '\0');
+        auto src = reinterpret_cast<const uint8_t *>(in.data());
+        ascii_lower(src, len, reinterpret_cast<uint8_t *>(out.data()));
+        for (size_t i = 0; i < len; i++) {
+            uint8_t c = src[i];
+            uint8_t want = c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+            CHECK(static_cast<uint8_t>(out[i]) == want);
+        }
+    }
+    std::string s = "Hello WORLD \xc3\x84pfel, ZZZ! 0123456789 ABCdef";
+    auto data = reinterpret_cast<uint8_t *>(s.data());
+    ascii_lower(data, s.size(), data);
+    CHECK(s == "hello world \xc3\x84pfel, zzz! 0123456789 abcdef");
+}
+
+static void test_tokenize() {
+    CHECK((words("  c++ co-routines, caf\xc3\xa9 42!") ==
+           std::vector<std::string>{"c", "co", "routines", "caf\xc3\xa9",
+                                    "42"}));
+    CHECK(words(" ,. ").empty());
+}
+
+// non-ASCII spaces and punctuation split words, letters do not
+static void test_tokenize_unicode() {
+    using words_t = std::vector<std::string>;
+    // em dash, guillemets, NBSP, multiplication sign
+    CHECK((words("foo\xe2\x80\x94" "bar") == words_t{"foo", "bar"}));
+    CHECK((words("\xc2\xabx\xc2\xbb") == words_t{"x"}));
+    CHECK((words("10\xc2\xa0km 2\xc3\x97" "3") ==
+           words_t{"10", "km", "2", "3"}));
+    // ideographic space and full stop, zero width no-break space
+    CHECK((words("\xe6\x97\xa5\xe6\x9c\xac\xe3\x80\x80\xe8\xaa\x9e"
+                 "\xe3\x80\x82\xef\xbb\xbf") ==
+           words_t{"\xe6\x97\xa5\xe6\x9c\xac", "\xe8\xaa\x9e"}));
+    // micro sign, ordinal indicator, emoji and malformed bytes stay inside
+    CHECK((words("5\xc2\xb5m 1\xc2\xba \xf0\x9f\x98\x80x a\xff\xe2\x80z") ==
+           words_t{"5\xc2\xb5m", "1\xc2\xba", "\xf0\x9f\x98\x80x",
+                   "a\xff\xe2\x80z"}));
+    // a separator cut off by the end of the input
+    CHECK((words("ab\xe2\x80") == words_t{"ab\xe2\x80"}));
+}
+
+static void test_highlight() {
+    std::vector<std::string> terms = {"linux", "caf\xc3\xa9"};
+    CHECK(highlight("Linux kernel", terms, "<b>", "</b>") ==
+          "<b>Linux</b> kernel");
+    CHECK(highlight("linuxes", terms, "<b>", "</b>") == "linuxes");
+    CHECK(highlight("le caf\xc3\xa9.", terms, "[", "]") ==
+          "le [caf\xc3\xa9].");
+    CHECK(highlight("\xc2\xabLinux\xc2\xbb\xe2\x80\x94" "caf\xc3\xa9", terms,
+                    "[", "]") ==
+          "\xc2\xab[Linux]\xc2\xbb\xe2\x80\x94[caf\xc3\xa9]");
+    // everything but the tags is escaped
+    CHECK(highlight("<script>alert('linux & \"co\"')</script>", terms,
+                    "<mark>", "</mark>") ==
+          "&lt;script&gt;alert(&#39;<mark>linux</mark> &amp; "
+          "&quot;co&quot;&#39;)&lt;/script&gt;");
+    CHECK(highlight("a<b", {}, "<mark>", "</mark>") == "a&lt;b");
+    CHECK(highlight("", terms, "<mark>", "</mark>").empty());
+}
+
+int main() {
+    test_ascii();
+    test_valid_multibyte();
+    test_invalid();
+    test_ascii_lower();
+    test_tokenize();
+    test_tokenize_unicode();
+    test_highlight();
+    return 0;
+}
@@ -3,12 +3,46 @@ add_rules("mode.debug", "mode.release")
 -- includes("script/packages.lua")
 add_requires("quickjs")
 add_requires("spdlog")
+add_requires("zlib")
+add_requires("brotli")
+add_requires("zstd")
+add_requires("openssl")
 
 set_languages("c++20")
 
+target("searxpp_core")
+    set_kind("static")
+    add_files("src/**.cpp|main.cpp")
+    add_includedirs("src", {public = true})
+    add_packages("quickjs", "spdlog", "zlib", "brotli", "zstd", "openssl",
+                 {public = true})
+    if is_plat("linux", "bsd") then
+        add_syslinks("pthread", {public = true})
+    end
+
 target("searxpp")
     set_kind("binary")
-    add_files("src/**.cpp")
-    add_includedirs("src")
-    add_packages("quickjs", "spdlog")
-    add_installfiles("test/*.js")
\ No newline at end of file
+    add_deps("searxpp_core")
+    add_files("src/main.cpp")
+    add_installfiles("test/*.js")
+
+target("harness")
+    set_kind("binary")
+    set_default(false)
+    add_deps("searxpp_core")
+    add_files("bench/*.cpp")
+
+-- xmake test
+for _, file in ipairs(os.files("test/unit/*_test.cpp")) do
+    target(path.basename(file))
+        set_kind("binary")
+        set_default(false)
+        add_deps("searxpp_core")
+        add_files(file)
+        -- the replay upstream is part of the harness, not the core
+        if path.basename(file) == "mock_server_test" then
+            add_files("bench/mock_server.cpp")
+            add_includedirs("bench")
+        end
+        add_tests("default", {rundir = os.projectdir()})
+end